@@ -0,0 +1,115 @@
+//
+//  ADCE.cpp
+//  uscc
+//
+//  Implements the Aggressive Dead Code Elimination opt pass.
+//  Instructions are assumed dead unless they are reached
+//  from a live root (a store, call or terminator), so dead
+//  cycles of phis are removed along with everything else.
+//
+//---------------------------------------------------------
+//  Copyright (c) 2014, Sanjay Madhav
+//  All rights reserved.
+//
+//  This file is distributed under the BSD license.
+//  See LICENSE.TXT for details.
+//---------------------------------------------------------
+#include "Passes.h"
+#include "../parse/TimeTrace.h"
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wconversion"
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+#pragma clang diagnostic pop
+#include <vector>
+
+using namespace llvm;
+
+namespace uscc
+{
+namespace opt
+{
+
+bool ADCE::runOnFunction(Function& F)
+{
+	parse::TimeScope timer("ADCE", F.getName());
+
+	mLive.clear();
+	mWorklist.clear();
+
+	// The roots are the instructions that have an effect outside of
+	// their value. Branches are always live, so every block still
+	// reaches the same successors (and control dependence holds).
+	for (BasicBlock& block : F)
+	{
+		for (Instruction& instr : block)
+		{
+			if (isa<TerminatorInst>(&instr) || instr.mayHaveSideEffects())
+			{
+				markLive(&instr);
+			}
+		}
+	}
+
+	// Anything a live instruction uses is live
+	while (!mWorklist.empty())
+	{
+		Instruction* instr = mWorklist.back();
+		mWorklist.pop_back();
+		for (Value* operand : instr->operands())
+		{
+			if (Instruction* opInstr = dyn_cast<Instruction>(operand))
+			{
+				markLive(opInstr);
+			}
+		}
+	}
+
+	std::vector<Instruction*> dead;
+	for (BasicBlock& block : F)
+	{
+		for (Instruction& instr : block)
+		{
+			if (mLive.count(&instr) == 0)
+			{
+				dead.push_back(&instr);
+			}
+		}
+	}
+
+	// The dead instructions may use each other (such as a cycle of phis),
+	// so their operands are all dropped before any of them are erased
+	for (Instruction* instr : dead)
+	{
+		instr->dropAllReferences();
+	}
+
+	for (Instruction* instr : dead)
+	{
+		instr->eraseFromParent();
+	}
+
+	mLive.clear();
+
+	return !dead.empty();
+}
+
+void ADCE::getAnalysisUsage(AnalysisUsage& Info) const
+{
+	// Branches are never removed
+	Info.setPreservesCFG();
+}
+
+// Marks the instruction as live, and queues it to mark its operands
+void ADCE::markLive(Instruction* instr)
+{
+	if (mLive.insert(instr).second)
+	{
+		mWorklist.push_back(instr);
+	}
+}
+
+} // opt
+} // uscc
+
+char uscc::opt::ADCE::ID = 0;
@@ -0,0 +1,268 @@
+//
+//  ArrayPromotion.cpp
+//  uscc
+//
+//  Implements the Array Promotion opt pass.
+//  Small local arrays that are only indexed by constants
+//  are split into one alloca per element, which are then
+//  promoted to SSA values.
+//
+//---------------------------------------------------------
+//  Copyright (c) 2014, Sanjay Madhav
+//  All rights reserved.
+//
+//  This file is distributed under the BSD license.
+//  See LICENSE.TXT for details.
+//---------------------------------------------------------
+#include "Passes.h"
+#include "../parse/TimeTrace.h"
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wconversion"
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/Transforms/Utils/PromoteMemToReg.h>
+#pragma clang diagnostic pop
+#include <vector>
+
+using namespace llvm;
+
+namespace
+{
+	// Arrays with more elements than this are left in memory
+	const uint64_t MaxElements = 16;
+
+	// Returns true if the only uses of the pointer are loads from it,
+	// and stores to it
+	bool isOnlyLoadedOrStored(Value* ptr)
+	{
+		for (Use& use : ptr->uses())
+		{
+			User* user = use.getUser();
+			if (isa<LoadInst>(user))
+			{
+				continue;
+			}
+
+			// (It can't be the value that's stored)
+			StoreInst* store = dyn_cast<StoreInst>(user);
+			if (store == nullptr || store->getPointerOperand() != ptr)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// If the GEP is a constant index into the array (which has count elements),
+	// returns the index. Otherwise, returns -1.
+	int64_t getConstantIndex(GetElementPtrInst* gep, uint64_t count)
+	{
+		if (gep->getNumIndices() != 1)
+		{
+			return -1;
+		}
+
+		ConstantInt* idx = dyn_cast<ConstantInt>(gep->getOperand(1));
+		if (idx == nullptr || idx->isNegative() || idx->getZExtValue() >= count)
+		{
+			return -1;
+		}
+
+		return static_cast<int64_t>(idx->getZExtValue());
+	}
+
+	// Returns true if the value is the cast of the array that's passed
+	// to its llvm.lifetime markers
+	bool isLifetimeCast(User* user)
+	{
+		if (!isa<BitCastInst>(user))
+		{
+			return false;
+		}
+
+		for (User* castUser : user->users())
+		{
+			IntrinsicInst* intrinsic = dyn_cast<IntrinsicInst>(castUser);
+			if (intrinsic == nullptr ||
+				(intrinsic->getIntrinsicID() != Intrinsic::lifetime_start &&
+				 intrinsic->getIntrinsicID() != Intrinsic::lifetime_end))
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+}
+
+namespace uscc
+{
+namespace opt
+{
+
+bool ArrayPromotion::runOnFunction(Function& F)
+{
+	parse::TimeScope timer("ArrayPromotion", F.getName());
+
+	// Local arrays are always allocated in the entry block, and then
+	// accessed through a GEP to their first element (which is the
+	// value of the identifier)
+	std::vector<AllocaInst*> arrays;
+	for (Instruction& instr : F.getEntryBlock())
+	{
+		AllocaInst* alloca = dyn_cast<AllocaInst>(&instr);
+		if (alloca == nullptr || alloca->isArrayAllocation())
+		{
+			continue;
+		}
+
+		ArrayType* type = dyn_cast<ArrayType>(alloca->getAllocatedType());
+		if (type != nullptr && type->getNumElements() <= MaxElements &&
+			canPromote(alloca))
+		{
+			arrays.push_back(alloca);
+		}
+	}
+
+	if (arrays.empty())
+	{
+		return false;
+	}
+
+	std::vector<AllocaInst*> elements;
+	for (AllocaInst* alloca : arrays)
+	{
+		promoteArray(alloca, elements);
+	}
+
+	DominatorTree& domTree = getAnalysis<DominatorTreeWrapperPass>().getDomTree();
+	PromoteMemToReg(elements, domTree);
+
+	return true;
+}
+
+void ArrayPromotion::getAnalysisUsage(AnalysisUsage& Info) const
+{
+	// This only replaces instructions, so the CFG is the same
+	Info.setPreservesCFG();
+	Info.addRequired<DominatorTreeWrapperPass>();
+}
+
+// Returns true if all the accesses to the array are loads or
+// stores of elements at constant indices
+bool ArrayPromotion::canPromote(AllocaInst* alloca)
+{
+	uint64_t count = cast<ArrayType>(alloca->getAllocatedType())->getNumElements();
+
+	for (User* user : alloca->users())
+	{
+		// (The markers are just removed along with the array)
+		if (isLifetimeCast(user))
+		{
+			continue;
+		}
+
+		// Otherwise this has to be the GEP to the first element
+		GetElementPtrInst* base = dyn_cast<GetElementPtrInst>(user);
+		if (base == nullptr || !base->hasAllZeroIndices() || base->getNumIndices() != 2)
+		{
+			return false;
+		}
+
+		for (User* baseUser : base->users())
+		{
+			GetElementPtrInst* gep = dyn_cast<GetElementPtrInst>(baseUser);
+			if (gep != nullptr)
+			{
+				if (gep->getPointerOperand() != base || getConstantIndex(gep, count) < 0 ||
+					!isOnlyLoadedOrStored(gep))
+				{
+					return false;
+				}
+			}
+			else if (isa<StoreInst>(baseUser))
+			{
+				if (cast<StoreInst>(baseUser)->getPointerOperand() != base)
+				{
+					return false;
+				}
+			}
+			else if (!isa<LoadInst>(baseUser))
+			{
+				// Anything else (such as a call, or the memcpy of a
+				// string initializer) needs the array in memory
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+// Replaces the array with one alloca per element that's accessed,
+// and adds them to elements
+void ArrayPromotion::promoteArray(AllocaInst* alloca, std::vector<AllocaInst*>& elements)
+{
+	ArrayType* type = cast<ArrayType>(alloca->getAllocatedType());
+	uint64_t count = type->getNumElements();
+
+	// (Created on demand, so elements that are never accessed are dropped)
+	std::vector<AllocaInst*> slots(count, nullptr);
+	auto getSlot = [&](uint64_t index) {
+		if (slots[index] == nullptr)
+		{
+			slots[index] = new AllocaInst(type->getElementType(),
+										  alloca->getName() + "." + Twine(index),
+										  alloca);
+			elements.push_back(slots[index]);
+		}
+		return slots[index];
+	};
+
+	while (!alloca->use_empty())
+	{
+		Instruction* user = cast<Instruction>(alloca->user_back());
+		if (isa<BitCastInst>(user))
+		{
+			while (!user->use_empty())
+			{
+				cast<Instruction>(user->user_back())->eraseFromParent();
+			}
+			user->eraseFromParent();
+			continue;
+		}
+
+		GetElementPtrInst* base = cast<GetElementPtrInst>(user);
+
+		while (!base->use_empty())
+		{
+			User* baseUser = base->user_back();
+			GetElementPtrInst* gep = dyn_cast<GetElementPtrInst>(baseUser);
+			if (gep != nullptr)
+			{
+				// The GEP has the same type as the element's alloca,
+				// so its loads and stores can just use the alloca
+				gep->replaceAllUsesWith(getSlot(getConstantIndex(gep, count)));
+				gep->eraseFromParent();
+			}
+			else
+			{
+				// A load or store of the first element
+				baseUser->replaceUsesOfWith(base, getSlot(0));
+			}
+		}
+
+		base->eraseFromParent();
+	}
+
+	alloca->eraseFromParent();
+}
+
+} // opt
+} // uscc
+
+char uscc::opt::ArrayPromotion::ID = 0;
@@ -13,9 +13,11 @@
 //  See LICENSE.TXT for details.
 //---------------------------------------------------------
 #include "Passes.h"
+#include "../parse/TimeTrace.h"
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wconversion"
 #include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
 #include <llvm/IR/CFG.h>
 #include <llvm/ADT/DepthFirstIterator.h>
 #pragma clang diagnostic pop
@@ -30,10 +32,40 @@ namespace opt
 	
 bool DeadBlocks::runOnFunction(Function& F)
 {
+	parse::TimeScope timer("DeadBlocks", F.getName());
+	
 	bool changed = false;
 	
     // PA5: Implement
     
+    // First fold the branches that SCCP found can only go one way,
+    // which leaves the blocks it found can't execute unreachable
+    SCCP& sccp = getAnalysis<SCCP>();
+    for (BasicBlock& block : F)
+    {
+        BranchInst* branch = dyn_cast<BranchInst>(block.getTerminator());
+        if (branch == nullptr || !branch->isConditional() || !sccp.isBlockExecutable(&block))
+        {
+            continue;
+        }
+        
+        BasicBlock* trueBlock = branch->getSuccessor(0);
+        BasicBlock* falseBlock = branch->getSuccessor(1);
+        bool trueTaken = sccp.isEdgeExecutable(&block, trueBlock);
+        bool falseTaken = sccp.isEdgeExecutable(&block, falseBlock);
+        if (trueTaken != falseTaken)
+        {
+            BasicBlock* taken = trueTaken ? trueBlock : falseBlock;
+            BasicBlock* notTaken = trueTaken ? falseBlock : trueBlock;
+            
+            // Notify the successor that's no longer branched to
+            notTaken->removePredecessor(&block);
+            BranchInst::Create(taken, &block);
+            branch->eraseFromParent();
+            changed = true;
+        }
+    }
+    
     // Make a set that contains blocks that are not dead
     std::set<BasicBlock*> visitedSet;
     
@@ -80,8 +112,16 @@ bool DeadBlocks::runOnFunction(Function& F)
             // Tell successor to remove the deadblock as predecessor
             succ_it->removePredecessor(deadblock);
         }
-        // Remove deadblock
-        deadblock->removeFromParent();
+        // Dead blocks may use each other's values, so drop all the
+        // references before any of them are erased
+        deadblock->dropAllReferences();
+    }
+    
+    // Erase the dead blocks (removing them from the function would leak them)
+    for (BasicBlock* deadblock : unreachableSet)
+    {
+        deadblock->eraseFromParent();
+        changed = true;
     }
 	
 	return changed;
@@ -91,7 +131,7 @@ void DeadBlocks::getAnalysisUsage(AnalysisUsage& Info) const
 {
 	// PA5: Implement
     
-    Info.addRequired<ConstantBranch>();
+    Info.addRequired<SCCP>();
 }
 
 } // opt
@@ -0,0 +1,239 @@
+//
+//  GVN.cpp
+//  uscc
+//
+//  Implements the Global Value Numbering opt pass.
+//  This walks the dominator tree with a scoped table of the
+//  pure expressions seen so far, and replaces an instruction
+//  with a dominating equivalent one. Loads are also reused,
+//  as long as no store or call can happen in between.
+//
+//---------------------------------------------------------
+//  Copyright (c) 2014, Sanjay Madhav
+//  All rights reserved.
+//
+//  This file is distributed under the BSD license.
+//  See LICENSE.TXT for details.
+//---------------------------------------------------------
+#include "Passes.h"
+#include "../parse/TimeTrace.h"
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wconversion"
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Dominators.h>
+#pragma clang diagnostic pop
+#include <map>
+#include <tuple>
+#include <vector>
+
+using namespace llvm;
+
+namespace
+{
+	// The key of an instruction in the table. Two instructions with the
+	// same expression compute the same value.
+	struct Expression
+	{
+		unsigned mOpcode;
+		// The compare predicate, or the flags (such as nsw)
+		unsigned mExtra;
+		// For loads, the memory generation they were in
+		unsigned mGeneration;
+		Type* mType;
+		std::vector<Value*> mOperands;
+
+		bool operator<(const Expression& rhs) const
+		{
+			return std::tie(mOpcode, mExtra, mGeneration, mType, mOperands) <
+				std::tie(rhs.mOpcode, rhs.mExtra, rhs.mGeneration, rhs.mType, rhs.mOperands);
+		}
+	};
+
+	// Returns true if the instruction is one whose value only depends
+	// on its operands (or, for a load, on the memory generation)
+	bool canNumber(Instruction* instr)
+	{
+		if (isa<BinaryOperator>(instr) || isa<CmpInst>(instr) || isa<CastInst>(instr) ||
+			isa<GetElementPtrInst>(instr) || isa<SelectInst>(instr))
+		{
+			return true;
+		}
+
+		LoadInst* load = dyn_cast<LoadInst>(instr);
+		return load != nullptr && load->isSimple();
+	}
+
+	Expression getExpression(Instruction* instr, unsigned generation)
+	{
+		Expression expr;
+		expr.mOpcode = instr->getOpcode();
+		expr.mExtra = instr->getRawSubclassOptionalData();
+		expr.mGeneration = isa<LoadInst>(instr) ? generation : 0;
+		expr.mType = instr->getType();
+		expr.mOperands.assign(instr->op_begin(), instr->op_end());
+
+		if (CmpInst* cmp = dyn_cast<CmpInst>(instr))
+		{
+			// a > b is the same as b < a, so the operands are put in
+			// a canonical order (and the predicate swapped to match)
+			CmpInst::Predicate pred = cmp->getPredicate();
+			if (expr.mOperands[1] < expr.mOperands[0])
+			{
+				std::swap(expr.mOperands[0], expr.mOperands[1]);
+				pred = CmpInst::getSwappedPredicate(pred);
+			}
+			expr.mExtra = pred;
+		}
+		else if (instr->isCommutative() && expr.mOperands[1] < expr.mOperands[0])
+		{
+			std::swap(expr.mOperands[0], expr.mOperands[1]);
+		}
+
+		return expr;
+	}
+
+	// A node of the dominator tree whose children are being visited
+	struct ScopeFrame
+	{
+		DomTreeNode* mNode;
+		unsigned mNextChild;
+		// The number of table entries that were added before this node
+		size_t mUndoSize;
+		// The memory generation at the end of this node's block
+		unsigned mGeneration;
+	};
+}
+
+namespace uscc
+{
+namespace opt
+{
+
+bool GVN::runOnFunction(Function& F)
+{
+	parse::TimeScope timer("GVN", F.getName());
+
+	DominatorTree& domTree = getAnalysis<DominatorTreeWrapperPass>().getDomTree();
+
+	bool changed = false;
+
+	// The expressions available in the current scope. Each one is
+	// added to the undo list, so leaving a scope can remove them.
+	std::map<Expression, Value*> table;
+	std::vector<std::map<Expression, Value*>::iterator> undo;
+
+	// Stores and calls start a new generation of memory,
+	// so loads from older generations can't be reused
+	unsigned generation = 0;
+
+	std::vector<ScopeFrame> stack;
+	DomTreeNode* node = domTree.getRootNode();
+	for (;;)
+	{
+		if (node != nullptr)
+		{
+			BasicBlock* block = node->getBlock();
+			ScopeFrame frame;
+			frame.mNode = node;
+			frame.mNextChild = 0;
+			frame.mUndoSize = undo.size();
+
+			// Memory is only known to be unchanged on entry to the block if
+			// its only predecessor is its immediate dominator (which just ran)
+			BasicBlock* pred = block->getSinglePredecessor();
+			if (pred == nullptr || node->getIDom() == nullptr ||
+				pred != node->getIDom()->getBlock())
+			{
+				generation++;
+			}
+
+			BasicBlock::iterator instrIter = block->begin();
+			while (instrIter != block->end())
+			{
+				Instruction* instr = instrIter;
+				++instrIter;
+
+				if (canNumber(instr))
+				{
+					auto result = table.insert(std::make_pair(getExpression(instr, generation),
+															  static_cast<Value*>(instr)));
+					if (result.second)
+					{
+						undo.push_back(result.first);
+					}
+					else
+					{
+						// There's a dominating instruction that computes the same value
+						instr->replaceAllUsesWith(result.first->second);
+						instr->eraseFromParent();
+						changed = true;
+					}
+				}
+				else if (instr->mayWriteToMemory())
+				{
+					generation++;
+
+					// The value that was stored can be loaded back
+					StoreInst* store = dyn_cast<StoreInst>(instr);
+					if (store != nullptr && store->isSimple())
+					{
+						Expression expr;
+						expr.mOpcode = Instruction::Load;
+						expr.mExtra = 0;
+						expr.mGeneration = generation;
+						expr.mType = store->getValueOperand()->getType();
+						expr.mOperands.push_back(store->getPointerOperand());
+
+						auto result = table.insert(std::make_pair(expr, store->getValueOperand()));
+						if (result.second)
+						{
+							undo.push_back(result.first);
+						}
+					}
+				}
+			}
+
+			frame.mGeneration = generation;
+			stack.push_back(frame);
+		}
+
+		if (stack.empty())
+		{
+			break;
+		}
+
+		// Visit the next child of the innermost scope, or leave it
+		ScopeFrame& top = stack.back();
+		if (top.mNextChild < top.mNode->getNumChildren())
+		{
+			node = top.mNode->getChildren()[top.mNextChild];
+			top.mNextChild++;
+			generation = top.mGeneration;
+		}
+		else
+		{
+			while (undo.size() > top.mUndoSize)
+			{
+				table.erase(undo.back());
+				undo.pop_back();
+			}
+			stack.pop_back();
+			node = nullptr;
+		}
+	}
+
+	return changed;
+}
+
+void GVN::getAnalysisUsage(AnalysisUsage& Info) const
+{
+	// GVN does not modify the CFG
+	Info.setPreservesCFG();
+	Info.addRequired<DominatorTreeWrapperPass>();
+}
+
+} // opt
+} // uscc
+
+char uscc::opt::GVN::ID = 0;
@@ -0,0 +1,250 @@
+//
+//  InductionVars.cpp
+//  uscc
+//
+//  Implements the Induction Variable opt pass.
+//  This finds the variables a loop steps by a constant
+//  (such as i in "++i"), and replaces the multiplications
+//  and array addresses computed from them with their own
+//  variables, which are stepped by an add each iteration.
+//  The exit test is also changed to compare against the
+//  final value, where that's known to be the same.
+//
+//---------------------------------------------------------
+//  Copyright (c) 2014, Sanjay Madhav
+//  All rights reserved.
+//
+//  This file is distributed under the BSD license.
+//  See LICENSE.TXT for details.
+//---------------------------------------------------------
+#include "Passes.h"
+#include "../parse/TimeTrace.h"
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wconversion"
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/Analysis/LoopInfo.h>
+#pragma clang diagnostic pop
+#include <vector>
+
+using namespace llvm;
+
+namespace uscc
+{
+namespace opt
+{
+
+bool InductionVars::runOnLoop(Loop* L, LPPassManager& LPM)
+{
+	parse::TimeScope timer("InductionVars", L->getHeader()->getParent()->getName());
+
+	mCurrLoop = L;
+	mChanged = false;
+
+	// The loops the emitter makes have a preheader, and a single latch
+	// (with the exit test) that branches back to the header
+	mPreheader = L->getLoopPreheader();
+	mLatch = L->getLoopLatch();
+	if (mPreheader == nullptr || mLatch == nullptr)
+	{
+		return false;
+	}
+
+	std::vector<InductionVar> ivs;
+	for (BasicBlock::iterator iter = L->getHeader()->begin(); isa<PHINode>(iter); ++iter)
+	{
+		InductionVar iv;
+		if (getInductionVar(cast<PHINode>(iter), iv))
+		{
+			ivs.push_back(iv);
+		}
+	}
+
+	for (InductionVar& iv : ivs)
+	{
+		reduceUsers(iv);
+		replaceExitTest(iv);
+	}
+
+	return mChanged;
+}
+
+void InductionVars::getAnalysisUsage(AnalysisUsage& Info) const
+{
+	// This only adds phis and arithmetic
+	Info.setPreservesCFG();
+	Info.addRequired<DominatorTreeWrapperPass>();
+	Info.addRequired<LoopInfo>();
+}
+
+// If the phi is incremented by a constant on each iteration, fills in
+// the induction variable and returns true
+bool InductionVars::getInductionVar(PHINode* phi, InductionVar& iv)
+{
+	if (!phi->getType()->isIntegerTy() || phi->getNumIncomingValues() != 2)
+	{
+		return false;
+	}
+
+	// (The constant is always on the right, once Peephole has run)
+	BinaryOperator* next = dyn_cast<BinaryOperator>(phi->getIncomingValueForBlock(mLatch));
+	if (next == nullptr || next->getOperand(0) != phi ||
+		(next->getOpcode() != Instruction::Add && next->getOpcode() != Instruction::Sub))
+	{
+		return false;
+	}
+
+	ConstantInt* step = dyn_cast<ConstantInt>(next->getOperand(1));
+	if (step == nullptr || step->isZero())
+	{
+		return false;
+	}
+
+	iv.mPhi = phi;
+	iv.mInit = phi->getIncomingValueForBlock(mPreheader);
+	iv.mNext = next;
+	iv.mStep = (next->getOpcode() == Instruction::Add) ? step :
+		cast<ConstantInt>(ConstantExpr::getNeg(step));
+	return true;
+}
+
+// Returns a new phi in the header, which starts at init
+// (The caller adds its value from the latch)
+PHINode* InductionVars::createRecurrence(Type* type, Value* init, const Twine& name)
+{
+	PHINode* phi = PHINode::Create(type, 2, name, mCurrLoop->getHeader()->begin());
+	phi->addIncoming(init, mPreheader);
+	return phi;
+}
+
+// Replaces the multiplications of the variable by constants, and the
+// array addresses indexed by it, with variables of their own
+void InductionVars::reduceUsers(InductionVar& iv)
+{
+	std::vector<Instruction*> users;
+	for (User* user : iv.mPhi->users())
+	{
+		Instruction* instr = cast<Instruction>(user);
+		if (mCurrLoop->contains(instr->getParent()))
+		{
+			users.push_back(instr);
+		}
+	}
+
+	IRBuilder<> pre(mPreheader->getTerminator());
+	IRBuilder<> latch(mLatch->getTerminator());
+	for (Instruction* instr : users)
+	{
+		// i*c (or i<<k) is c*init on the first iteration,
+		// and goes up by c*step each iteration
+		ConstantInt* factor = nullptr;
+		BinaryOperator* binOp = dyn_cast<BinaryOperator>(instr);
+		if (binOp != nullptr && binOp->getOperand(0) == iv.mPhi)
+		{
+			ConstantInt* rhs = dyn_cast<ConstantInt>(binOp->getOperand(1));
+			if (rhs != nullptr && binOp->getOpcode() == Instruction::Mul)
+			{
+				factor = rhs;
+			}
+			else if (rhs != nullptr && binOp->getOpcode() == Instruction::Shl &&
+					 rhs->getZExtValue() < rhs->getBitWidth())
+			{
+				factor = ConstantInt::get(rhs->getType(), 1ULL << rhs->getZExtValue());
+			}
+		}
+
+		if (factor != nullptr)
+		{
+			Value* init = pre.CreateMul(iv.mInit, factor);
+			PHINode* phi = createRecurrence(instr->getType(), init, instr->getName() + ".iv");
+			Constant* step = ConstantExpr::getMul(iv.mStep, factor);
+			phi->addIncoming(latch.CreateAdd(phi, step), mLatch);
+
+			instr->replaceAllUsesWith(phi);
+			instr->eraseFromParent();
+			mChanged = true;
+			continue;
+		}
+
+		// &base[i] is &base[init] on the first iteration, and moves by
+		// step elements each iteration. The index is sign extended, so
+		// this is only the same if i can't overflow.
+		GetElementPtrInst* gep = dyn_cast<GetElementPtrInst>(instr);
+		if (gep != nullptr && gep->getNumIndices() == 1 && gep->getOperand(1) == iv.mPhi &&
+			mCurrLoop->isLoopInvariant(gep->getPointerOperand()) && iv.mNext->hasNoSignedWrap())
+		{
+			Value* init = pre.CreateGEP(gep->getPointerOperand(), iv.mInit);
+			PHINode* phi = createRecurrence(gep->getType(), init, gep->getName() + ".iv");
+			phi->addIncoming(latch.CreateGEP(phi, iv.mStep), mLatch);
+
+			gep->replaceAllUsesWith(phi);
+			gep->eraseFromParent();
+			mChanged = true;
+		}
+	}
+}
+
+// If the loop continues while i+1 < n, and it was only entered if
+// init < n, i+1 reaches n exactly, so the test can be i+1 != n
+void InductionVars::replaceExitTest(InductionVar& iv)
+{
+	BranchInst* branch = dyn_cast<BranchInst>(mLatch->getTerminator());
+	if (branch == nullptr || branch->isUnconditional() ||
+		branch->getSuccessor(0) != mCurrLoop->getHeader() ||
+		!iv.mStep->isOne() || !iv.mNext->hasNoSignedWrap())
+	{
+		return;
+	}
+
+	ICmpInst* test = dyn_cast<ICmpInst>(branch->getCondition());
+	if (test == nullptr || test->getPredicate() != CmpInst::ICMP_SLT ||
+		test->getOperand(0) != iv.mNext || !mCurrLoop->isLoopInvariant(test->getOperand(1)))
+	{
+		return;
+	}
+
+	Value* bound = test->getOperand(1);
+	if (!isEnteredBelow(iv.mInit, bound))
+	{
+		return;
+	}
+
+	test->setPredicate(CmpInst::ICMP_NE);
+	mChanged = true;
+}
+
+// Returns true if the loop is only entered when init < bound (which is
+// the case for the guard the emitter puts in front of a while loop)
+bool InductionVars::isEnteredBelow(Value* init, Value* bound)
+{
+	ConstantInt* initConst = dyn_cast<ConstantInt>(init);
+	ConstantInt* boundConst = dyn_cast<ConstantInt>(bound);
+	if (initConst != nullptr && boundConst != nullptr)
+	{
+		return initConst->getValue().slt(boundConst->getValue());
+	}
+
+	BasicBlock* guardBlock = mPreheader->getSinglePredecessor();
+	if (guardBlock == nullptr)
+	{
+		return false;
+	}
+
+	BranchInst* guard = dyn_cast<BranchInst>(guardBlock->getTerminator());
+	if (guard == nullptr || guard->isUnconditional() || guard->getSuccessor(0) != mPreheader ||
+		guard->getSuccessor(1) == mPreheader)
+	{
+		return false;
+	}
+
+	ICmpInst* test = dyn_cast<ICmpInst>(guard->getCondition());
+	return test != nullptr && test->getPredicate() == CmpInst::ICMP_SLT &&
+		test->getOperand(0) == init && test->getOperand(1) == bound;
+}
+
+} // opt
+} // uscc
+
+char uscc::opt::InductionVars::ID = 0;
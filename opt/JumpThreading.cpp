@@ -0,0 +1,255 @@
+//
+//  JumpThreading.cpp
+//  uscc
+//
+//  Implements the Jump Threading opt pass.
+//  When a block's branch only depends on the values of its
+//  phis, and a predecessor gives them constant values, that
+//  predecessor jumps straight to the successor that would be
+//  taken (through a copy of the block's other instructions).
+//
+//---------------------------------------------------------
+//  Copyright (c) 2014, Sanjay Madhav
+//  All rights reserved.
+//
+//  This file is distributed under the BSD license.
+//  See LICENSE.TXT for details.
+//---------------------------------------------------------
+#include "Passes.h"
+#include "../parse/TimeTrace.h"
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wconversion"
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/CFG.h>
+#include <llvm/Analysis/CFG.h>
+#include <llvm/Transforms/Utils/SSAUpdater.h>
+#pragma clang diagnostic pop
+#include <algorithm>
+#include <vector>
+
+using namespace llvm;
+
+namespace
+{
+	// Blocks with more instructions than this (besides their phis
+	// and branch) aren't copied
+	const unsigned MaxDuplicate = 6;
+
+	// Returns the value v has when block is entered from pred
+	Value* getIncomingValue(Value* v, BasicBlock* block, BasicBlock* pred)
+	{
+		PHINode* phi = dyn_cast<PHINode>(v);
+		if (phi != nullptr && phi->getParent() == block)
+		{
+			return phi->getIncomingValueForBlock(pred);
+		}
+
+		return v;
+	}
+}
+
+namespace uscc
+{
+namespace opt
+{
+
+bool JumpThreading::runOnFunction(Function& F)
+{
+	parse::TimeScope timer("JumpThreading", F.getName());
+
+	// Threading into or through a loop header could make a
+	// loop with more than one entry, so they're left alone
+	mLoopHeaders.clear();
+	SmallVector<std::pair<const BasicBlock*, const BasicBlock*>, 16> backEdges;
+	FindFunctionBackedges(F, backEdges);
+	for (auto& edge : backEdges)
+	{
+		mLoopHeaders.insert(const_cast<BasicBlock*>(edge.second));
+	}
+
+	bool changed = false;
+	bool iterChanged = true;
+	while (iterChanged)
+	{
+		iterChanged = false;
+		for (BasicBlock& block : F)
+		{
+			iterChanged |= threadBlock(&block);
+		}
+		changed |= iterChanged;
+	}
+
+	return changed;
+}
+
+void JumpThreading::getAnalysisUsage(AnalysisUsage& Info) const
+{
+	// This changes the CFG, so nothing is preserved
+}
+
+// If the branch at the end of the block is decided by the values
+// of its phis, threads the predecessors that give them constants
+bool JumpThreading::threadBlock(BasicBlock* block)
+{
+	BranchInst* branch = dyn_cast<BranchInst>(block->getTerminator());
+	if (branch == nullptr || branch->isUnconditional() || mLoopHeaders.count(block) != 0 ||
+		!isa<PHINode>(block->begin()))
+	{
+		return false;
+	}
+
+	unsigned size = 0;
+	for (Instruction& instr : *block)
+	{
+		if (!isa<PHINode>(&instr) && &instr != branch)
+		{
+			size++;
+		}
+	}
+
+	if (size > MaxDuplicate)
+	{
+		return false;
+	}
+
+	bool changed = false;
+	std::vector<BasicBlock*> preds(pred_begin(block), pred_end(block));
+	for (size_t i = 0; i < preds.size(); i++)
+	{
+		BasicBlock* pred = preds[i];
+
+		// (A predecessor that branches here both ways is listed twice)
+		if (pred == block || std::count(preds.begin(), preds.end(), pred) != 1 ||
+			!isa<BranchInst>(pred->getTerminator()))
+		{
+			continue;
+		}
+
+		ConstantInt* cond = getConditionFrom(branch, pred);
+		if (cond == nullptr)
+		{
+			continue;
+		}
+
+		// (Successor 0 is taken if the condition is true)
+		BasicBlock* succ = branch->getSuccessor(cond->isOne() ? 0 : 1);
+		if (succ == block || mLoopHeaders.count(succ) != 0)
+		{
+			continue;
+		}
+
+		threadEdge(pred, block, succ);
+		changed = true;
+	}
+
+	return changed;
+}
+
+// Returns the condition of the branch when its block is entered from
+// pred, if it's a constant then (otherwise, returns nullptr)
+ConstantInt* JumpThreading::getConditionFrom(BranchInst* branch, BasicBlock* pred)
+{
+	BasicBlock* block = branch->getParent();
+	Value* cond = branch->getCondition();
+
+	if (ICmpInst* cmp = dyn_cast<ICmpInst>(cond))
+	{
+		if (cmp->getParent() != block)
+		{
+			return nullptr;
+		}
+
+		Constant* lhs = dyn_cast<Constant>(getIncomingValue(cmp->getOperand(0), block, pred));
+		Constant* rhs = dyn_cast<Constant>(getIncomingValue(cmp->getOperand(1), block, pred));
+		if (lhs == nullptr || rhs == nullptr)
+		{
+			return nullptr;
+		}
+
+		return dyn_cast<ConstantInt>(ConstantExpr::getICmp(cmp->getPredicate(), lhs, rhs));
+	}
+
+	return dyn_cast<ConstantInt>(getIncomingValue(cond, block, pred));
+}
+
+// Makes pred branch to a copy of block that goes straight to succ
+void JumpThreading::threadEdge(BasicBlock* pred, BasicBlock* block, BasicBlock* succ)
+{
+	BasicBlock* copy = BasicBlock::Create(block->getContext(), block->getName() + ".thread",
+										  block->getParent(), block);
+
+	// The phis are replaced by their values from pred, and
+	// the other instructions are copied
+	DenseMap<Value*, Value*> values;
+	for (Instruction& instr : *block)
+	{
+		if (PHINode* phi = dyn_cast<PHINode>(&instr))
+		{
+			values[phi] = phi->getIncomingValueForBlock(pred);
+		}
+		else if (!isa<TerminatorInst>(&instr))
+		{
+			Instruction* clone = instr.clone();
+			clone->setName(instr.getName());
+			for (unsigned i = 0; i < clone->getNumOperands(); i++)
+			{
+				auto iter = values.find(clone->getOperand(i));
+				if (iter != values.end())
+				{
+					clone->setOperand(i, iter->second);
+				}
+			}
+			copy->getInstList().push_back(clone);
+			values[&instr] = clone;
+		}
+	}
+	BranchInst::Create(succ, copy);
+
+	// The successor's phis get the same values from the copy
+	for (BasicBlock::iterator iter = succ->begin(); isa<PHINode>(iter); ++iter)
+	{
+		PHINode* phi = cast<PHINode>(iter);
+		Value* value = phi->getIncomingValueForBlock(block);
+		auto mapped = values.find(value);
+		phi->addIncoming(mapped != values.end() ? mapped->second : value, copy);
+	}
+
+	block->removePredecessor(pred, true);
+	pred->getTerminator()->replaceUsesOfWith(block, copy);
+
+	// The values defined in the block now have two definitions, so the
+	// uses after it (which it no longer dominates) need phis to merge them
+	for (Instruction& instr : *block)
+	{
+		std::vector<Use*> uses;
+		for (Use& use : instr.uses())
+		{
+			Instruction* user = cast<Instruction>(use.getUser());
+			if (user->getParent() != block || isa<PHINode>(user))
+			{
+				uses.push_back(&use);
+			}
+		}
+
+		if (uses.empty())
+		{
+			continue;
+		}
+
+		SSAUpdater updater;
+		updater.Initialize(instr.getType(), instr.getName());
+		updater.AddAvailableValue(block, &instr);
+		updater.AddAvailableValue(copy, values[&instr]);
+		for (Use* use : uses)
+		{
+			updater.RewriteUse(*use);
+		}
+	}
+}
+
+} // opt
+} // uscc
+
+char uscc::opt::JumpThreading::ID = 0;
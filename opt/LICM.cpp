@@ -12,6 +12,7 @@
 //  See LICENSE.TXT for details.
 //---------------------------------------------------------
 #include "Passes.h"
+#include "../parse/TimeTrace.h"
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wconversion"
 #include <llvm/IR/Function.h>
@@ -30,6 +31,8 @@ namespace opt
 	
 bool LICM::runOnLoop(llvm::Loop *L, llvm::LPPassManager &LPM)
 {
+	parse::TimeScope timer("LICM", L->getHeader()->getParent()->getName());
+	
 	mChanged = false;
 	
 	// PA5: Implement
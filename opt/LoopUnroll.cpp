@@ -0,0 +1,421 @@
+//
+//  LoopUnroll.cpp
+//  uscc
+//
+//  Implements the Loop Unrolling opt pass.
+//  The trip count of a loop that steps a variable from a
+//  constant until it fails a compare against a constant is
+//  found by running the exit test. Small loops are replaced
+//  with one copy of the body per iteration, and bigger ones
+//  run several copies per iteration, with the original loop
+//  left to run the iterations that remain.
+//
+//---------------------------------------------------------
+//  Copyright (c) 2014, Sanjay Madhav
+//  All rights reserved.
+//
+//  This file is distributed under the BSD license.
+//  See LICENSE.TXT for details.
+//---------------------------------------------------------
+#include "Passes.h"
+#include "../parse/TimeTrace.h"
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wconversion"
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/Analysis/LoopInfo.h>
+#pragma clang diagnostic pop
+#include <vector>
+
+using namespace llvm;
+
+namespace
+{
+	// The copies of the body can't have more instructions than this
+	// in total (which is the cost model for both kinds of unrolling)
+	const uint64_t MaxUnrolledSize = 128;
+
+	// Loops that run more times than this aren't counted
+	const unsigned MaxTripCount = 65536;
+
+	// Returns the result of the compare on the constants
+	bool evaluateCompare(CmpInst::Predicate pred, const APInt& lhs, const APInt& rhs)
+	{
+		switch (pred)
+		{
+			case CmpInst::ICMP_EQ:
+				return lhs.eq(rhs);
+			case CmpInst::ICMP_NE:
+				return lhs.ne(rhs);
+			case CmpInst::ICMP_SLT:
+				return lhs.slt(rhs);
+			case CmpInst::ICMP_SLE:
+				return lhs.sle(rhs);
+			case CmpInst::ICMP_SGT:
+				return lhs.sgt(rhs);
+			case CmpInst::ICMP_SGE:
+				return lhs.sge(rhs);
+			case CmpInst::ICMP_ULT:
+				return lhs.ult(rhs);
+			case CmpInst::ICMP_ULE:
+				return lhs.ule(rhs);
+			case CmpInst::ICMP_UGT:
+				return lhs.ugt(rhs);
+			default:
+				return lhs.uge(rhs);
+		}
+	}
+
+	// Returns the value the copy of this value has, if it was copied
+	Value* lookup(DenseMap<Value*, Value*>& values, Value* value)
+	{
+		auto iter = values.find(value);
+		return (iter != values.end()) ? iter->second : value;
+	}
+}
+
+namespace uscc
+{
+namespace opt
+{
+
+bool LoopUnroll::runOnFunction(Function& F)
+{
+	parse::TimeScope timer("LoopUnroll", F.getName());
+
+	LoopInfo& loopInfo = getAnalysis<LoopInfo>();
+
+	// Only innermost loops that are a single block are unrolled, so the
+	// blocks of the other loops aren't changed by unrolling one of them
+	std::vector<Loop*> loops;
+	std::vector<Loop*> worklist(loopInfo.begin(), loopInfo.end());
+	while (!worklist.empty())
+	{
+		Loop* L = worklist.back();
+		worklist.pop_back();
+		if (!L->getSubLoops().empty())
+		{
+			worklist.insert(worklist.end(), L->begin(), L->end());
+		}
+		else if (L->getNumBlocks() == 1)
+		{
+			loops.push_back(L);
+		}
+	}
+
+	bool changed = false;
+	for (Loop* L : loops)
+	{
+		changed |= unrollLoop(L);
+	}
+
+	return changed;
+}
+
+void LoopUnroll::getAnalysisUsage(AnalysisUsage& Info) const
+{
+	// The loops are removed, so nothing is preserved
+	Info.addRequired<LoopInfo>();
+}
+
+// Unrolls the loop (which is a single block) if it runs a
+// constant number of times, and the copies aren't too big
+bool LoopUnroll::unrollLoop(Loop* L)
+{
+	mBlock = L->getHeader();
+	mPreheader = L->getLoopPreheader();
+	if (mPreheader == nullptr)
+	{
+		return false;
+	}
+
+	BranchInst* branch = dyn_cast<BranchInst>(mBlock->getTerminator());
+	if (branch == nullptr || branch->isUnconditional())
+	{
+		return false;
+	}
+
+	mExit = branch->getSuccessor(branch->getSuccessor(0) == mBlock ? 1 : 0);
+	if (mExit == mBlock)
+	{
+		return false;
+	}
+
+	TripCount trip;
+	if (!getTripCount(branch, trip))
+	{
+		return false;
+	}
+
+	// The size of the body is what's copied (the phis and branch aren't)
+	uint64_t size = 0;
+	for (Instruction& instr : *mBlock)
+	{
+		if (!isa<PHINode>(&instr) && !isa<TerminatorInst>(&instr))
+		{
+			size++;
+		}
+	}
+
+	if (trip.mCount * size <= MaxUnrolledSize)
+	{
+		fullyUnroll(trip);
+		return true;
+	}
+	else if (mFactor > 1 && mFactor * size <= MaxUnrolledSize)
+	{
+		// (Since the loop is too big to fully unroll,
+		// it runs more than mFactor times)
+		partiallyUnroll(trip);
+		return true;
+	}
+
+	return false;
+}
+
+// If the exit test compares a counted variable against a constant,
+// fills in the trip count and returns true
+bool LoopUnroll::getTripCount(BranchInst* branch, TripCount& trip)
+{
+	ICmpInst* cmp = dyn_cast<ICmpInst>(branch->getCondition());
+	if (cmp == nullptr)
+	{
+		return false;
+	}
+
+	bool continueIfTrue = branch->getSuccessor(0) == mBlock;
+
+	for (BasicBlock::iterator iter = mBlock->begin(); isa<PHINode>(iter); ++iter)
+	{
+		PHINode* phi = cast<PHINode>(iter);
+		ConstantInt* init = dyn_cast<ConstantInt>(phi->getIncomingValueForBlock(mPreheader));
+		if (init == nullptr)
+		{
+			continue;
+		}
+
+		// (The constant is always on the right, once Peephole has run)
+		BinaryOperator* next = dyn_cast<BinaryOperator>(phi->getIncomingValueForBlock(mBlock));
+		if (next == nullptr || next->getOperand(0) != phi ||
+			(next->getOpcode() != Instruction::Add && next->getOpcode() != Instruction::Sub))
+		{
+			continue;
+		}
+
+		ConstantInt* step = dyn_cast<ConstantInt>(next->getOperand(1));
+		if (step == nullptr || step->isZero())
+		{
+			continue;
+		}
+
+		if (next->getOpcode() == Instruction::Sub)
+		{
+			step = cast<ConstantInt>(ConstantExpr::getNeg(step));
+		}
+
+		// The test can be on the variable before or after it's stepped,
+		// and the variable can be on either side
+		unsigned side = (cmp->getOperand(0) == phi || cmp->getOperand(0) == next) ? 0 : 1;
+		Value* tested = cmp->getOperand(side);
+		ConstantInt* bound = dyn_cast<ConstantInt>(cmp->getOperand(1 - side));
+		if ((tested != phi && tested != next) || bound == nullptr)
+		{
+			continue;
+		}
+
+		// Run the exit test until it fails
+		APInt value = init->getValue();
+		for (unsigned count = 1; count <= MaxTripCount; count++)
+		{
+			APInt nextValue = value + step->getValue();
+			const APInt& testedValue = (tested == phi) ? value : nextValue;
+			bool result = (side == 0) ?
+				evaluateCompare(cmp->getPredicate(), testedValue, bound->getValue()) :
+				evaluateCompare(cmp->getPredicate(), bound->getValue(), testedValue);
+			if (result != continueIfTrue)
+			{
+				trip.mPhi = phi;
+				trip.mInit = init;
+				trip.mStep = step;
+				trip.mCount = count;
+				return true;
+			}
+
+			value = nextValue;
+		}
+	}
+
+	return false;
+}
+
+// Replaces the loop with one copy of the body per iteration
+void LoopUnroll::fullyUnroll(const TripCount& trip)
+{
+	Function* F = mBlock->getParent();
+	BasicBlock* unrolled = BasicBlock::Create(F->getContext(), mBlock->getName() + ".unrolled",
+											  F, mBlock);
+
+	// The first copy uses the values the phis start with
+	DenseMap<Value*, Value*> values;
+	for (BasicBlock::iterator iter = mBlock->begin(); isa<PHINode>(iter); ++iter)
+	{
+		PHINode* phi = cast<PHINode>(iter);
+		values[phi] = phi->getIncomingValueForBlock(mPreheader);
+	}
+
+	for (unsigned i = 0; i < trip.mCount; i++)
+	{
+		if (i > 0)
+		{
+			advancePhis(values);
+		}
+		copyBody(unrolled, values);
+	}
+
+	// (The copies of the exit test are left for ADCE)
+	BranchInst::Create(mExit, unrolled);
+	mPreheader->getTerminator()->replaceUsesOfWith(mBlock, unrolled);
+	replaceExitUses(unrolled, values);
+
+	mBlock->dropAllReferences();
+	mBlock->eraseFromParent();
+}
+
+// Replaces the loop with one that runs mFactor copies of the body
+// per iteration, followed by the original loop for the rest
+void LoopUnroll::partiallyUnroll(const TripCount& trip)
+{
+	Function* F = mBlock->getParent();
+	BasicBlock* unrolled = BasicBlock::Create(F->getContext(), mBlock->getName() + ".unrolled",
+											  F, mBlock);
+
+	// The unrolled loop has its own phis, which start with the same values
+	std::vector<PHINode*> phis;
+	std::vector<PHINode*> copies;
+	DenseMap<Value*, Value*> values;
+	for (BasicBlock::iterator iter = mBlock->begin(); isa<PHINode>(iter); ++iter)
+	{
+		PHINode* phi = cast<PHINode>(iter);
+		PHINode* copy = PHINode::Create(phi->getType(), 2, phi->getName(), unrolled);
+		copy->addIncoming(phi->getIncomingValueForBlock(mPreheader), mPreheader);
+		values[phi] = copy;
+		phis.push_back(phi);
+		copies.push_back(copy);
+	}
+
+	for (unsigned i = 0; i < mFactor; i++)
+	{
+		if (i > 0)
+		{
+			advancePhis(values);
+		}
+		copyBody(unrolled, values);
+	}
+
+	// (The values of the last copy are the ones seen after the loop)
+	DenseMap<Value*, Value*> lastValues = values;
+	advancePhis(values);
+	for (size_t i = 0; i < phis.size(); i++)
+	{
+		copies[i]->addIncoming(values[phis[i]], unrolled);
+	}
+
+	// The unrolled loop runs count / mFactor times, so it continues until
+	// the variable reaches the value it has after that many iterations
+	unsigned remainder = trip.mCount % mFactor;
+	APInt iterations(trip.mStep->getBitWidth(), trip.mCount - remainder);
+	Constant* finalValue = ConstantInt::get(trip.mStep->getType(),
+											trip.mInit->getValue() + trip.mStep->getValue() * iterations);
+
+	IRBuilder<> builder(unrolled);
+	Value* cond = builder.CreateICmpNE(values[trip.mPhi], finalValue, "unroll.cond");
+	builder.CreateCondBr(cond, unrolled, (remainder != 0) ? mBlock : mExit);
+	mPreheader->getTerminator()->replaceUsesOfWith(mBlock, unrolled);
+
+	if (remainder != 0)
+	{
+		// The original loop runs the rest, starting where the unrolled one stopped
+		for (PHINode* phi : phis)
+		{
+			int index = phi->getBasicBlockIndex(mPreheader);
+			phi->setIncomingValue(static_cast<unsigned>(index), values[phi]);
+			phi->setIncomingBlock(static_cast<unsigned>(index), unrolled);
+		}
+	}
+	else
+	{
+		replaceExitUses(unrolled, lastValues);
+		mBlock->dropAllReferences();
+		mBlock->eraseFromParent();
+	}
+}
+
+// Copies the body (without the phis and branch) to the end of dest,
+// using the copies of the values in values. Adds the new copies to values.
+void LoopUnroll::copyBody(BasicBlock* dest, DenseMap<Value*, Value*>& values)
+{
+	for (Instruction& instr : *mBlock)
+	{
+		if (isa<PHINode>(&instr) || isa<TerminatorInst>(&instr))
+		{
+			continue;
+		}
+
+		Instruction* copy = instr.clone();
+		copy->setName(instr.getName());
+		for (unsigned i = 0; i < copy->getNumOperands(); i++)
+		{
+			copy->setOperand(i, lookup(values, copy->getOperand(i)));
+		}
+
+		dest->getInstList().push_back(copy);
+		values[&instr] = copy;
+	}
+}
+
+// Changes the values of the phis in values to the ones they have
+// in the next iteration
+void LoopUnroll::advancePhis(DenseMap<Value*, Value*>& values)
+{
+	// (All of them are looked up first, since a phi's next
+	// value can be the current value of another phi)
+	std::vector<std::pair<PHINode*, Value*>> next;
+	for (BasicBlock::iterator iter = mBlock->begin(); isa<PHINode>(iter); ++iter)
+	{
+		PHINode* phi = cast<PHINode>(iter);
+		next.push_back(std::make_pair(phi, lookup(values, phi->getIncomingValueForBlock(mBlock))));
+	}
+
+	for (auto& entry : next)
+	{
+		values[entry.first] = entry.second;
+	}
+}
+
+// Changes the uses of the body's values after the loop to their
+// values in values, which are computed in the block that replaces it
+void LoopUnroll::replaceExitUses(BasicBlock* replacement, DenseMap<Value*, Value*>& values)
+{
+	for (Instruction& instr : *mBlock)
+	{
+		// (The users are copied first, since their uses change)
+		std::vector<User*> users(instr.user_begin(), instr.user_end());
+		for (User* user : users)
+		{
+			if (cast<Instruction>(user)->getParent() != mBlock)
+			{
+				user->replaceUsesOfWith(&instr, lookup(values, &instr));
+			}
+		}
+	}
+
+	// The phis after the loop now get their values from the replacement
+	mBlock->replaceSuccessorsPhiUsesWith(replacement);
+}
+
+} // opt
+} // uscc
+
+char uscc::opt::LoopUnroll::ID = 0;
@@ -0,0 +1,209 @@
+//
+//  Narrowing.cpp
+//  uscc
+//
+//  Implements the Integer Narrowing opt pass.
+//  chars are extended to ints for arithmetic, and truncated
+//  back afterwards. When only the low bits of a computation
+//  are used, this does it in the narrower type instead, which
+//  removes the sext/trunc round trips.
+//
+//---------------------------------------------------------
+//  Copyright (c) 2014, Sanjay Madhav
+//  All rights reserved.
+//
+//  This file is distributed under the BSD license.
+//  See LICENSE.TXT for details.
+//---------------------------------------------------------
+#include "Passes.h"
+#include "../parse/TimeTrace.h"
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wconversion"
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/IRBuilder.h>
+#pragma clang diagnostic pop
+
+using namespace llvm;
+
+namespace
+{
+	// Returns true if the low bits of the operation's result only
+	// depend on the low bits of its operands
+	bool isLowBitsOp(BinaryOperator* binOp, unsigned bits)
+	{
+		switch (binOp->getOpcode())
+		{
+			case Instruction::Add:
+			case Instruction::Sub:
+			case Instruction::Mul:
+			case Instruction::And:
+			case Instruction::Or:
+			case Instruction::Xor:
+				return true;
+			case Instruction::Shl:
+			{
+				// (Only if the shift amount is also the same when narrowed)
+				ConstantInt* amount = dyn_cast<ConstantInt>(binOp->getOperand(1));
+				return amount != nullptr && amount->getZExtValue() < bits;
+			}
+			default:
+				return false;
+		}
+	}
+}
+
+namespace uscc
+{
+namespace opt
+{
+
+bool Narrowing::runOnFunction(Function& F)
+{
+	parse::TimeScope timer("Narrowing", F.getName());
+
+	bool changed = false;
+	for (BasicBlock& block : F)
+	{
+		BasicBlock::iterator instrIter = block.begin();
+		while (instrIter != block.end())
+		{
+			Instruction* instr = instrIter;
+			++instrIter;
+
+			Value* replacement = nullptr;
+			if (TruncInst* trunc = dyn_cast<TruncInst>(instr))
+			{
+				IntegerType* type = cast<IntegerType>(trunc->getType());
+				if (canNarrow(trunc->getOperand(0), type))
+				{
+					replacement = narrow(trunc->getOperand(0), type, trunc);
+				}
+			}
+			else if (ICmpInst* cmp = dyn_cast<ICmpInst>(instr))
+			{
+				replacement = narrowCmp(cmp);
+			}
+
+			if (replacement != nullptr)
+			{
+				// (The instructions that computed the wide value are
+				// left for ADCE)
+				instr->replaceAllUsesWith(replacement);
+				instr->eraseFromParent();
+				changed = true;
+			}
+		}
+	}
+
+	return changed;
+}
+
+void Narrowing::getAnalysisUsage(AnalysisUsage& Info) const
+{
+	// This only replaces instructions
+	Info.setPreservesCFG();
+}
+
+// Returns true if the value can be computed in the narrower type
+// without adding any truncations
+bool Narrowing::canNarrow(Value* value, IntegerType* type)
+{
+	if (isa<ConstantInt>(value) || isa<SExtInst>(value) || isa<ZExtInst>(value))
+	{
+		return true;
+	}
+
+	// (If the operation has other users, it still has to be done wide)
+	BinaryOperator* binOp = dyn_cast<BinaryOperator>(value);
+	if (binOp != nullptr && binOp->hasOneUse() && isLowBitsOp(binOp, type->getBitWidth()))
+	{
+		return canNarrow(binOp->getOperand(0), type) && canNarrow(binOp->getOperand(1), type);
+	}
+
+	return false;
+}
+
+// Returns the low bits of the value, computed in the narrower type
+// before insertBefore (The value must be one that canNarrow accepted)
+Value* Narrowing::narrow(Value* value, IntegerType* type, Instruction* insertBefore)
+{
+	if (ConstantInt* constant = dyn_cast<ConstantInt>(value))
+	{
+		return ConstantExpr::getTrunc(constant, type);
+	}
+
+	// An extension is removed (or changed to one that's narrower)
+	IRBuilder<> build(insertBefore);
+	CastInst* ext = dyn_cast<CastInst>(value);
+	if (ext != nullptr && (isa<SExtInst>(ext) || isa<ZExtInst>(ext)))
+	{
+		Value* src = ext->getOperand(0);
+		unsigned srcBits = src->getType()->getIntegerBitWidth();
+		if (srcBits == type->getBitWidth())
+		{
+			return src;
+		}
+		else if (srcBits > type->getBitWidth())
+		{
+			return build.CreateTrunc(src, type);
+		}
+		else
+		{
+			return build.CreateCast(ext->getOpcode(), src, type);
+		}
+	}
+
+	BinaryOperator* binOp = cast<BinaryOperator>(value);
+	Value* lhs = narrow(binOp->getOperand(0), type, insertBefore);
+	Value* rhs = narrow(binOp->getOperand(1), type, insertBefore);
+	return build.CreateBinOp(binOp->getOpcode(), lhs, rhs);
+}
+
+// If the compare is of two sign-extended values (or one and a constant
+// that fits), returns the same compare of the values before they were
+// extended. Otherwise, returns nullptr.
+Value* Narrowing::narrowCmp(ICmpInst* cmp)
+{
+	SExtInst* lhs = dyn_cast<SExtInst>(cmp->getOperand(0));
+	if (lhs == nullptr)
+	{
+		return nullptr;
+	}
+
+	// Sign extension doesn't change the order or equality of values
+	Value* src = lhs->getOperand(0);
+	Type* type = src->getType();
+	Value* rhs = cmp->getOperand(1);
+	Value* narrowRhs = nullptr;
+	if (SExtInst* rhsExt = dyn_cast<SExtInst>(rhs))
+	{
+		if (rhsExt->getOperand(0)->getType() == type)
+		{
+			narrowRhs = rhsExt->getOperand(0);
+		}
+	}
+	else if (ConstantInt* constant = dyn_cast<ConstantInt>(rhs))
+	{
+		// (The constant has to be the same once it's truncated)
+		Constant* truncated = ConstantExpr::getTrunc(constant, type);
+		if (ConstantExpr::getSExt(truncated, constant->getType()) == constant)
+		{
+			narrowRhs = truncated;
+		}
+	}
+
+	if (narrowRhs == nullptr)
+	{
+		return nullptr;
+	}
+
+	IRBuilder<> build(cmp);
+	return build.CreateICmp(cmp->getPredicate(), src, narrowRhs);
+}
+
+} // opt
+} // uscc
+
+char uscc::opt::Narrowing::ID = 0;
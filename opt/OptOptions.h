@@ -0,0 +1,42 @@
+//
+//  OptOptions.h
+//  uscc
+//
+//  Declares the options that control the opt passes
+//  (which are set from the command line)
+//
+//---------------------------------------------------------
+//  Copyright (c) 2014, Sanjay Madhav
+//  All rights reserved.
+//
+//  This file is distributed under the BSD license.
+//  See LICENSE.TXT for details.
+//---------------------------------------------------------
+
+#pragma once
+
+namespace uscc
+{
+namespace opt
+{
+
+struct OptOptions
+{
+	OptOptions()
+	: mPrintRanges(false)
+	, mUnrollLoops(true)
+	, mUnrollFactor(4)
+	{ }
+	
+	// Print the value ranges of each function to stderr
+	bool mPrintRanges;
+	
+	// Unroll the loops that run a constant number of times
+	bool mUnrollLoops;
+	
+	// The number of copies of the body in a partially unrolled loop
+	unsigned mUnrollFactor;
+};
+
+} // opt
+} // uscc
@@ -19,21 +19,45 @@
 #include <llvm/PassRegistry.h>
 
 using namespace llvm;
+using namespace uscc::opt;
+
+namespace
+{
+	// The passes are also in the registry, so if a pass requires one
+	// that a later pass invalidated (such as LICM, which requires
+	// DeadBlocks), the pass manager can run it again
+	RegisterPass<SCCP> sccpPass("uscc-sccp", "Sparse conditional constant propagation");
+	RegisterPass<DeadBlocks> deadBlocksPass("uscc-deadblocks", "Dead block removal");
+	RegisterPass<ValueRange> valueRangePass("uscc-ranges", "Value range analysis", false, true);
+}
 
 namespace uscc
 {
 namespace opt
 {
 
-void registerOptPasses(legacy::PassManager& pm)
+void registerOptPasses(legacy::PassManager& pm, const OptOptions& options)
 {
 	PassRegistry& pr = *PassRegistry::getPassRegistry();
 	initializeLoopInfoPass(pr);
 	initializeDominatorTreeWrapperPassPass(pr);
-	pm.add(new ConstantOps());
-	pm.add(new ConstantBranch());
+	pm.add(new ArrayPromotion());
+	pm.add(new SCCP());
 	pm.add(new DeadBlocks());
+	pm.add(new Peephole());
+	pm.add(new Narrowing());
+	pm.add(new JumpThreading());
+	pm.add(new GVN());
+	pm.add(new ValueRange(options.mPrintRanges));
+	pm.add(new RangeFold());
+	if (options.mUnrollLoops)
+	{
+		pm.add(new LoopUnroll(options.mUnrollFactor));
+	}
 	pm.add(new LICM());
+	pm.add(new InductionVars());
+	pm.add(new ADCE());
+	pm.add(new SimplifyCFG());
 	pm.add(new DominatorTreeWrapperPass());
 	pm.add(new LoopInfo());
 }
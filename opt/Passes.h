@@ -4,11 +4,20 @@
 //
 //  Declares the opt passes supported by USCC
 //
-//  At the moment, there are four passes:
-//     * Constant op removal
-//     * Constant branch folding
-//     * Removal of dead blocks from CFG
+//  At the moment, there are thirteen passes:
+//     * Promotion of small local arrays to SSA values
+//     * Sparse conditional constant propagation (SCCP)
+//     * Removal of dead branches and blocks from CFG
+//     * Algebraic peephole simplifications
+//     * Narrowing of char arithmetic
+//     * Jump threading
+//     * Global value numbering (GVN)
+//     * Folding of compares decided by value ranges
+//     * Loop unrolling
 //     * Loop Invariant Code Motion (LICM)
+//     * Induction variable strength reduction
+//     * Aggressive dead code elimination (ADCE)
+//     * CFG simplification
 //
 //  These passes will execute if uscc is ran with -O
 //
@@ -26,7 +35,29 @@
 #include <llvm/Analysis/LoopPass.h>
 #include <llvm/IR/LegacyPassManager.h>
 #include <llvm/IR/Dominators.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/DenseSet.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/IR/InstrTypes.h>
 #pragma clang diagnostic pop
+#include "OptOptions.h"
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// LLVM forward-declarations
+namespace llvm
+{
+	class AllocaInst;
+	class BinaryOperator;
+	class BranchInst;
+	class Constant;
+	class ConstantInt;
+	class ICmpInst;
+	class IntegerType;
+	class PHINode;
+	class Twine;
+}
 
 using llvm::FunctionPass;
 using llvm::LoopPass;
@@ -38,31 +69,91 @@ namespace opt
 {
 
 // Helper function for registering the opt passes
-void registerOptPasses(llvm::legacy::PassManager& pm);
+void registerOptPasses(llvm::legacy::PassManager& pm, const OptOptions& options = OptOptions());
 
-// Declares the Constant Propagation Pass
-struct ConstantOps : public FunctionPass
+// Declares the Array Promotion Pass
+struct ArrayPromotion : public FunctionPass
 {
 	static char ID;
-	ConstantOps() : FunctionPass(ID) {}
+	ArrayPromotion() : FunctionPass(ID) {}
 	
 	virtual bool runOnFunction(llvm::Function& F) override;
 	
 	virtual void getAnalysisUsage(llvm::AnalysisUsage& Info) const override;
+	
+	// Returns true if all the accesses to the array are loads or
+	// stores of elements at constant indices
+	bool canPromote(llvm::AllocaInst* alloca);
+	
+	// Replaces the array with one alloca per element that's accessed,
+	// and adds them to elements
+	void promoteArray(llvm::AllocaInst* alloca, std::vector<llvm::AllocaInst*>& elements);
 };
 
-// Declares the Constant Branch Folding Pass
-struct ConstantBranch : public FunctionPass
+// Declares the Sparse Conditional Constant Propagation Pass
+struct SCCP : public FunctionPass
 {
 	static char ID;
-	ConstantBranch() : FunctionPass(ID) {}
+	SCCP() : FunctionPass(ID) {}
 	
 	virtual bool runOnFunction(llvm::Function& F) override;
 	
 	virtual void getAnalysisUsage(llvm::AnalysisUsage& Info) const override;
+	
+	// Returns true if the block/edge can execute
+	// (for the function this pass was last run on)
+	bool isBlockExecutable(llvm::BasicBlock* block) const;
+	bool isEdgeExecutable(llvm::BasicBlock* from, llvm::BasicBlock* to) const;
+	
+	// The value of an instruction, which starts out unknown, and can
+	// only be lowered (to a constant, and then to overdefined)
+	struct LatticeVal
+	{
+		enum State
+		{
+			Unknown,
+			Const,
+			Overdefined
+		};
+		
+		LatticeVal() : mState(Unknown), mConst(nullptr) {}
+		
+		State mState;
+		llvm::ConstantInt* mConst;
+	};
+	
+	// Returns the current lattice value of this value
+	LatticeVal getValue(llvm::Value* value) const;
+	
+	// Lowers the instruction's value, and revisits its users if it changed
+	void markConstant(llvm::Instruction* instr, llvm::ConstantInt* constant);
+	void markOverdefined(llvm::Instruction* instr);
+	void markFolded(llvm::Instruction* instr, llvm::Constant* folded);
+	void pushUsers(llvm::Instruction* instr);
+	
+	void markBlockExecutable(llvm::BasicBlock* block);
+	void markEdgeExecutable(llvm::BasicBlock* from, llvm::BasicBlock* to);
+	
+	// Evaluates the instruction with the current values of its operands
+	void visitInstr(llvm::Instruction* instr);
+	void visitPhi(llvm::PHINode* phi);
+	void visitBranch(llvm::BranchInst* branch);
+	
+	// The values of the instructions that have been visited
+	llvm::DenseMap<llvm::Value*, LatticeVal> mValues;
+	
+	// The blocks and edges that can execute
+	llvm::SmallPtrSet<llvm::BasicBlock*, 32> mExecBlocks;
+	llvm::DenseSet<std::pair<llvm::BasicBlock*, llvm::BasicBlock*>> mExecEdges;
+	
+	// The blocks that became executable, and the instructions whose
+	// operands changed, which still need to be visited
+	std::vector<llvm::BasicBlock*> mBlockWorklist;
+	std::vector<llvm::Instruction*> mInstrWorklist;
 };
 
 // Declares the Dead Block Removal Pass
+// (This also folds the branches SCCP found can only go one way)
 struct DeadBlocks : public FunctionPass
 {
 	static char ID;
@@ -72,6 +163,238 @@ struct DeadBlocks : public FunctionPass
 	
 	virtual void getAnalysisUsage(llvm::AnalysisUsage& Info) const override;
 };
+
+// Declares the Peephole Pass
+// (Algebraic identities with one constant operand)
+struct Peephole : public FunctionPass
+{
+	static char ID;
+	Peephole() : FunctionPass(ID) {}
+	
+	virtual bool runOnFunction(llvm::Function& F) override;
+	
+	virtual void getAnalysisUsage(llvm::AnalysisUsage& Info) const override;
+	
+	// Moves the constant operand of a commutative operation or
+	// a compare to the right-hand side
+	bool canonicalize(llvm::Instruction* instr);
+	
+	// Returns the simpler value that can replace the instruction (which may
+	// be a new instruction), or nullptr if it can't be simplified
+	llvm::Value* simplify(llvm::Instruction* instr);
+	llvm::Value* simplifyBinOp(llvm::BinaryOperator* binOp);
+	llvm::Value* simplifyCmp(llvm::ICmpInst* cmp);
+};
+
+// Declares the Narrowing Pass
+// (Does arithmetic on extended chars in i8 if only the low bits are used)
+struct Narrowing : public FunctionPass
+{
+	static char ID;
+	Narrowing() : FunctionPass(ID) {}
+	
+	virtual bool runOnFunction(llvm::Function& F) override;
+	
+	virtual void getAnalysisUsage(llvm::AnalysisUsage& Info) const override;
+	
+	// Returns true if the value can be computed in the narrower type
+	// without adding any truncations
+	bool canNarrow(llvm::Value* value, llvm::IntegerType* type);
+	
+	// Returns the low bits of the value, computed in the narrower type
+	// before insertBefore (The value must be one that canNarrow accepted)
+	llvm::Value* narrow(llvm::Value* value, llvm::IntegerType* type,
+						llvm::Instruction* insertBefore);
+	
+	// If the compare is of two sign-extended values (or one and a constant
+	// that fits), returns the same compare of the values before they were
+	// extended. Otherwise, returns nullptr.
+	llvm::Value* narrowCmp(llvm::ICmpInst* cmp);
+};
+
+// Declares the Jump Threading Pass
+struct JumpThreading : public FunctionPass
+{
+	static char ID;
+	JumpThreading() : FunctionPass(ID) {}
+	
+	virtual bool runOnFunction(llvm::Function& F) override;
+	
+	virtual void getAnalysisUsage(llvm::AnalysisUsage& Info) const override;
+	
+	// If the branch at the end of the block is decided by the values
+	// of its phis, threads the predecessors that give them constants
+	bool threadBlock(llvm::BasicBlock* block);
+	
+	// Returns the condition of the branch when its block is entered from
+	// pred, if it's a constant then (otherwise, returns nullptr)
+	llvm::ConstantInt* getConditionFrom(llvm::BranchInst* branch, llvm::BasicBlock* pred);
+	
+	// Makes pred branch to a copy of block that goes straight to succ
+	void threadEdge(llvm::BasicBlock* pred, llvm::BasicBlock* block, llvm::BasicBlock* succ);
+	
+	// The blocks that are the target of a back edge
+	llvm::SmallPtrSet<llvm::BasicBlock*, 16> mLoopHeaders;
+};
+
+// Declares the Global Value Numbering Pass
+// (Replaces pure instructions and loads with dominating equivalents)
+struct GVN : public FunctionPass
+{
+	static char ID;
+	GVN() : FunctionPass(ID) {}
+	
+	virtual bool runOnFunction(llvm::Function& F) override;
+	
+	virtual void getAnalysisUsage(llvm::AnalysisUsage& Info) const override;
+};
+
+// Declares the Value Range analysis
+// (The interval of signed values each integer can have)
+struct ValueRange : public FunctionPass
+{
+	static char ID;
+	ValueRange(bool print = false) : FunctionPass(ID), mDomTree(nullptr), mPrint(print) {}
+	
+	virtual bool runOnFunction(llvm::Function& F) override;
+	
+	virtual void getAnalysisUsage(llvm::AnalysisUsage& Info) const override;
+	
+	// An interval of values, which is empty if mLo > mHi
+	// (i1 values are treated as unsigned)
+	struct Range
+	{
+		Range() : mLo(1), mHi(0) {}
+		Range(int64_t lo, int64_t hi) : mLo(lo), mHi(hi) {}
+		
+		bool isEmpty() const { return mLo > mHi; }
+		bool isSingle() const { return mLo == mHi; }
+		
+		int64_t mLo;
+		int64_t mHi;
+	};
+	
+	// Returns the range of the value where it's defined
+	// (An instruction that can't execute has an empty range)
+	Range getRange(llvm::Value* value) const;
+	
+	// Returns the range of the value in the block, which is narrowed by
+	// the conditions of the branches that lead to the block
+	Range getRangeAt(llvm::Value* value, llvm::BasicBlock* block) const;
+	
+	// Returns the range of the value when it flows along the edge
+	Range getRangeOnEdge(llvm::Value* value, llvm::BasicBlock* from, llvm::BasicBlock* to) const;
+	
+	// Returns the range the value must be in if the edge is taken
+	// (because of the condition of the branch)
+	Range getConstraint(llvm::Value* value, llvm::BasicBlock* from, llvm::BasicBlock* to) const;
+	
+	// Returns the range of the result of the instruction, from
+	// the current ranges of its operands
+	Range evaluate(llvm::Instruction* instr) const;
+	
+	// Prints the range of each integer instruction to stderr
+	void printRanges(llvm::Function& F) const;
+	
+	static Range getFullRange(llvm::Type* type);
+	static Range getUnion(const Range& a, const Range& b);
+	static Range getIntersection(const Range& a, const Range& b);
+	
+	// Returns the range if it fits in the type, or the full range if
+	// it doesn't (since the result wraps around)
+	static Range getWrapped(const Range& range, llvm::Type* type);
+	
+	// Returns the range of the (mathematically exact) result of the 32-bit
+	// or smaller operation, or an empty range if it's not known
+	static Range getExactRange(unsigned opcode, const Range& lhs, const Range& rhs);
+	
+	// Returns 1 if the compare is true for all the values in the ranges,
+	// 0 if it's false for all of them, and -1 if it depends
+	static int getCompareResult(llvm::CmpInst::Predicate pred, const Range& a, const Range& b);
+	
+	// The ranges of the integer instructions
+	llvm::DenseMap<llvm::Instruction*, Range> mRanges;
+	
+	llvm::DominatorTree* mDomTree;
+	
+	// Print the ranges after they're computed
+	bool mPrint;
+};
+
+// Declares the Range Folding Pass
+struct RangeFold : public FunctionPass
+{
+	static char ID;
+	RangeFold() : FunctionPass(ID) {}
+	
+	virtual bool runOnFunction(llvm::Function& F) override;
+	
+	virtual void getAnalysisUsage(llvm::AnalysisUsage& Info) const override;
+	
+	// Marks an add, sub or mul whose result is always in range as nsw
+	bool markNoWrap(llvm::BinaryOperator* binOp, ValueRange& ranges);
+	
+	// If the block's branch now has a constant condition, replaces it with
+	// a branch to the successor that's taken
+	bool foldBranch(llvm::BasicBlock* block);
+};
+
+// Declares the Loop Unrolling Pass
+struct LoopUnroll : public FunctionPass
+{
+	static char ID;
+	LoopUnroll(unsigned factor = 4) : FunctionPass(ID), mFactor(factor) {}
+	
+	virtual bool runOnFunction(llvm::Function& F) override;
+	
+	virtual void getAnalysisUsage(llvm::AnalysisUsage& Info) const override;
+	
+	// A loop variable that starts at a constant, and is stepped by a
+	// constant, until the exit test fails after mCount iterations
+	struct TripCount
+	{
+		llvm::PHINode* mPhi;
+		llvm::ConstantInt* mInit;
+		llvm::ConstantInt* mStep;
+		unsigned mCount;
+	};
+	
+	// Unrolls the loop (which is a single block) if it runs a
+	// constant number of times, and the copies aren't too big
+	bool unrollLoop(llvm::Loop* L);
+	
+	// If the exit test compares a counted variable against a constant,
+	// fills in the trip count and returns true
+	bool getTripCount(llvm::BranchInst* branch, TripCount& trip);
+	
+	// Replaces the loop with one copy of the body per iteration
+	void fullyUnroll(const TripCount& trip);
+	
+	// Replaces the loop with one that runs mFactor copies of the body
+	// per iteration, followed by the original loop for the rest
+	void partiallyUnroll(const TripCount& trip);
+	
+	// Copies the body (without the phis and branch) to the end of dest,
+	// using the copies of the values in values. Adds the new copies to values.
+	void copyBody(llvm::BasicBlock* dest, llvm::DenseMap<llvm::Value*, llvm::Value*>& values);
+	
+	// Changes the values of the phis in values to the ones they have
+	// in the next iteration
+	void advancePhis(llvm::DenseMap<llvm::Value*, llvm::Value*>& values);
+	
+	// Changes the uses of the body's values after the loop to their
+	// values in values, which are computed in the block that replaces it
+	void replaceExitUses(llvm::BasicBlock* replacement,
+						 llvm::DenseMap<llvm::Value*, llvm::Value*>& values);
+	
+	// The number of copies of the body a partially unrolled loop has
+	unsigned mFactor;
+	
+	// Data regarding the current loop
+	llvm::BasicBlock* mBlock;
+	llvm::BasicBlock* mPreheader;
+	llvm::BasicBlock* mExit;
+};
 	
 // Loop invariant code motion
 struct LICM : public LoopPass
@@ -101,6 +424,97 @@ struct LICM : public LoopPass
     
     void hoistPreOrder(llvm::DomTreeNode* dtn);
 };
+
+// Induction variable simplification and strength reduction
+struct InductionVars : public LoopPass
+{
+	static char ID;
+	InductionVars() : LoopPass(ID) {}
+	
+	virtual bool runOnLoop(llvm::Loop* L, llvm::LPPassManager& LPM) override;
+	
+	virtual void getAnalysisUsage(llvm::AnalysisUsage& Info) const override;
+	
+	// A variable that starts at mInit, and goes up by mStep each iteration
+	struct InductionVar
+	{
+		llvm::PHINode* mPhi;
+		llvm::Value* mInit;
+		llvm::BinaryOperator* mNext;
+		llvm::ConstantInt* mStep;
+	};
+	
+	// If the phi is incremented by a constant on each iteration, fills in
+	// the induction variable and returns true
+	bool getInductionVar(llvm::PHINode* phi, InductionVar& iv);
+	
+	// Returns a new phi in the header, which starts at init
+	// (The caller adds its value from the latch)
+	llvm::PHINode* createRecurrence(llvm::Type* type, llvm::Value* init, const llvm::Twine& name);
+	
+	// Replaces the multiplications of the variable by constants, and the
+	// array addresses indexed by it, with variables of their own
+	void reduceUsers(InductionVar& iv);
+	
+	// If the loop continues while i+1 < n, and it was only entered if
+	// init < n, i+1 reaches n exactly, so the test can be i+1 != n
+	void replaceExitTest(InductionVar& iv);
+	
+	// Returns true if the loop is only entered when init < bound
+	bool isEnteredBelow(llvm::Value* init, llvm::Value* bound);
+	
+	// Data regarding the current loop
+	llvm::Loop* mCurrLoop;
+	llvm::BasicBlock* mPreheader;
+	llvm::BasicBlock* mLatch;
+	
+	// Denotes whether or not loop has been modified
+	bool mChanged;
+};
+
+// Declares the Aggressive Dead Code Elimination Pass
+struct ADCE : public FunctionPass
+{
+	static char ID;
+	ADCE() : FunctionPass(ID) {}
+	
+	virtual bool runOnFunction(llvm::Function& F) override;
+	
+	virtual void getAnalysisUsage(llvm::AnalysisUsage& Info) const override;
+	
+	// Marks the instruction as live, and queues it to mark its operands
+	void markLive(llvm::Instruction* instr);
+	
+	// The instructions that are live, and the ones whose
+	// operands haven't been marked yet
+	llvm::SmallPtrSet<llvm::Instruction*, 32> mLive;
+	std::vector<llvm::Instruction*> mWorklist;
+};
+
+// Declares the CFG Simplification Pass
+struct SimplifyCFG : public FunctionPass
+{
+	static char ID;
+	SimplifyCFG() : FunctionPass(ID) {}
+	
+	virtual bool runOnFunction(llvm::Function& F) override;
+	
+	virtual void getAnalysisUsage(llvm::AnalysisUsage& Info) const override;
+	
+	// Erases the blocks that can't be reached from the entry block
+	bool removeUnreachableBlocks(llvm::Function& F);
+	
+	// Replaces the phis that only merge one value with that value
+	bool foldPhis(llvm::Function& F);
+	
+	// If the block's only predecessor only branches to it,
+	// moves the block's instructions to the end of the predecessor
+	bool mergeIntoPredecessor(llvm::BasicBlock* block);
+	
+	// If the block only branches to another block, changes its
+	// predecessors to branch to that block instead
+	bool forwardEmptyBlock(llvm::BasicBlock* block);
+};
 	
 } // opt
 } // uscc
\ No newline at end of file
@@ -0,0 +1,340 @@
+//
+//  Peephole.cpp
+//  uscc
+//
+//  Implements the Peephole opt pass.
+//  This applies algebraic identities to instructions with a
+//  constant operand (such as x+0 or x*1), and replaces the
+//  expensive ones (multiplication and signed division by
+//  powers of two) with shifts.
+//
+//---------------------------------------------------------
+//  Copyright (c) 2014, Sanjay Madhav
+//  All rights reserved.
+//
+//  This file is distributed under the BSD license.
+//  See LICENSE.TXT for details.
+//---------------------------------------------------------
+#include "Passes.h"
+#include "../parse/TimeTrace.h"
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wconversion"
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/IRBuilder.h>
+#pragma clang diagnostic pop
+
+using namespace llvm;
+
+namespace
+{
+	// If the value is a constant power of two (which is positive
+	// as a signed number), returns its log. Otherwise, returns -1.
+	int getPowerOfTwo(Value* value)
+	{
+		ConstantInt* constant = dyn_cast<ConstantInt>(value);
+		if (constant == nullptr || constant->isNegative() || !constant->getValue().isPowerOf2())
+		{
+			return -1;
+		}
+
+		return static_cast<int>(constant->getValue().logBase2());
+	}
+
+	// If the value is 0 - x, returns x. Otherwise, returns nullptr.
+	Value* getNegated(Value* value)
+	{
+		BinaryOperator* binOp = dyn_cast<BinaryOperator>(value);
+		if (binOp != nullptr && binOp->getOpcode() == Instruction::Sub)
+		{
+			ConstantInt* lhs = dyn_cast<ConstantInt>(binOp->getOperand(0));
+			if (lhs != nullptr && lhs->isZero())
+			{
+				return binOp->getOperand(1);
+			}
+		}
+
+		return nullptr;
+	}
+}
+
+namespace uscc
+{
+namespace opt
+{
+
+bool Peephole::runOnFunction(Function& F)
+{
+	parse::TimeScope timer("Peephole", F.getName());
+
+	// A simplified instruction may let its users simplify,
+	// so this repeats until nothing changes
+	bool changed = false;
+	bool iterChanged = true;
+	while (iterChanged)
+	{
+		iterChanged = false;
+		for (BasicBlock& block : F)
+		{
+			BasicBlock::iterator instrIter = block.begin();
+			while (instrIter != block.end())
+			{
+				Instruction* instr = instrIter;
+				++instrIter;
+
+				if (canonicalize(instr))
+				{
+					iterChanged = true;
+				}
+
+				Value* replacement = simplify(instr);
+				if (replacement != nullptr)
+				{
+					instr->replaceAllUsesWith(replacement);
+					instr->eraseFromParent();
+					iterChanged = true;
+				}
+			}
+		}
+		changed |= iterChanged;
+	}
+
+	return changed;
+}
+
+void Peephole::getAnalysisUsage(AnalysisUsage& Info) const
+{
+	// This only replaces instructions
+	Info.setPreservesCFG();
+}
+
+// Moves the constant operand of a commutative operation or
+// a compare to the right-hand side
+bool Peephole::canonicalize(Instruction* instr)
+{
+	if ((!isa<ICmpInst>(instr) && !isa<BinaryOperator>(instr)) ||
+		!isa<Constant>(instr->getOperand(0)) || isa<Constant>(instr->getOperand(1)))
+	{
+		return false;
+	}
+
+	if (ICmpInst* cmp = dyn_cast<ICmpInst>(instr))
+	{
+		// (This also swaps the predicate)
+		cmp->swapOperands();
+		return true;
+	}
+
+	BinaryOperator* binOp = dyn_cast<BinaryOperator>(instr);
+	if (binOp != nullptr && binOp->isCommutative())
+	{
+		return !binOp->swapOperands();
+	}
+
+	return false;
+}
+
+// Returns the simpler value that can replace the instruction (which may
+// be a new instruction), or nullptr if it can't be simplified
+Value* Peephole::simplify(Instruction* instr)
+{
+	if (BinaryOperator* binOp = dyn_cast<BinaryOperator>(instr))
+	{
+		return simplifyBinOp(binOp);
+	}
+	else if (ICmpInst* cmp = dyn_cast<ICmpInst>(instr))
+	{
+		return simplifyCmp(cmp);
+	}
+
+	return nullptr;
+}
+
+Value* Peephole::simplifyBinOp(BinaryOperator* binOp)
+{
+	Value* lhs = binOp->getOperand(0);
+	Value* rhs = binOp->getOperand(1);
+	Type* type = binOp->getType();
+	if (!type->isIntegerTy())
+	{
+		return nullptr;
+	}
+	unsigned bits = type->getIntegerBitWidth();
+
+	// (After canonicalize, only the rhs of a commutative operation is constant)
+	ConstantInt* constant = dyn_cast<ConstantInt>(rhs);
+	Constant* zero = Constant::getNullValue(type);
+
+	switch (binOp->getOpcode())
+	{
+		case Instruction::Add:
+		case Instruction::Or:
+		case Instruction::Shl:
+		case Instruction::AShr:
+		case Instruction::LShr:
+			// x+0, x|0 and x<<0 are x
+			if (constant != nullptr && constant->isZero())
+			{
+				return lhs;
+			}
+			break;
+		case Instruction::Sub:
+			// x-0 is x, and x-x is 0
+			if (constant != nullptr && constant->isZero())
+			{
+				return lhs;
+			}
+			else if (lhs == rhs)
+			{
+				return zero;
+			}
+			// 0-(0-x) is x
+			else if (getNegated(binOp) != nullptr && getNegated(rhs) != nullptr)
+			{
+				return getNegated(rhs);
+			}
+			break;
+		case Instruction::Xor:
+			// x^0 is x, and x^x is 0
+			if (constant != nullptr && constant->isZero())
+			{
+				return lhs;
+			}
+			else if (lhs == rhs)
+			{
+				return zero;
+			}
+			// ~~x is x, and !(a < b) is a >= b
+			else if (constant != nullptr && constant->isAllOnesValue())
+			{
+				BinaryOperator* inner = dyn_cast<BinaryOperator>(lhs);
+				ConstantInt* innerConst = inner ? dyn_cast<ConstantInt>(inner->getOperand(1)) : nullptr;
+				if (inner != nullptr && inner->getOpcode() == Instruction::Xor &&
+					innerConst != nullptr && innerConst->isAllOnesValue())
+				{
+					return inner->getOperand(0);
+				}
+
+				ICmpInst* cmp = dyn_cast<ICmpInst>(lhs);
+				if (cmp != nullptr && cmp->hasOneUse())
+				{
+					cmp->setPredicate(cmp->getInversePredicate());
+					return cmp;
+				}
+			}
+			break;
+		case Instruction::And:
+			// x&0 is 0
+			if (constant != nullptr && constant->isZero())
+			{
+				return zero;
+			}
+			break;
+		case Instruction::Mul:
+		{
+			// x*0 is 0, and x*1 is x
+			if (constant != nullptr && constant->isZero())
+			{
+				return zero;
+			}
+			else if (constant != nullptr && constant->isOne())
+			{
+				return lhs;
+			}
+
+			// x*2^k is x<<k
+			int log = getPowerOfTwo(rhs);
+			if (log > 0)
+			{
+				IRBuilder<> build(binOp);
+				return build.CreateShl(lhs, log, binOp->getName());
+			}
+			break;
+		}
+		case Instruction::SDiv:
+		{
+			// x/1 is x
+			if (constant != nullptr && constant->isOne())
+			{
+				return lhs;
+			}
+
+			// x/2^k is x>>k, once negative x are rounded towards 0 by
+			// adding 2^k-1 (which is the top k bits of the sign, shifted down)
+			int log = getPowerOfTwo(rhs);
+			if (log > 0)
+			{
+				IRBuilder<> build(binOp);
+				Value* bias = build.CreateLShr(build.CreateAShr(lhs, bits - 1), bits - log);
+				Value* biased = build.CreateAdd(lhs, bias);
+				return build.CreateAShr(biased, log, binOp->getName());
+			}
+			break;
+		}
+		case Instruction::SRem:
+		{
+			// x%1 is 0
+			if (constant != nullptr && constant->isOne())
+			{
+				return zero;
+			}
+
+			// x%2^k is x minus x/2^k*2^k, where the division rounds towards 0
+			// (so the remainder has the same sign as x)
+			int log = getPowerOfTwo(rhs);
+			if (log > 0)
+			{
+				IRBuilder<> build(binOp);
+				Value* bias = build.CreateLShr(build.CreateAShr(lhs, bits - 1), bits - log);
+				Value* biased = build.CreateAdd(lhs, bias);
+				Value* rounded = build.CreateAnd(biased, ConstantInt::get(type, -(1LL << log), true));
+				return build.CreateSub(lhs, rounded, binOp->getName());
+			}
+			break;
+		}
+		default:
+			break;
+	}
+
+	return nullptr;
+}
+
+Value* Peephole::simplifyCmp(ICmpInst* cmp)
+{
+	// A compare of a zero-extended condition against 0 is
+	// just the condition (or its inverse)
+	ZExtInst* ext = dyn_cast<ZExtInst>(cmp->getOperand(0));
+	ConstantInt* constant = dyn_cast<ConstantInt>(cmp->getOperand(1));
+	if (ext == nullptr || constant == nullptr || !constant->isZero() ||
+		!ext->getSrcTy()->isIntegerTy(1))
+	{
+		return nullptr;
+	}
+
+	Value* cond = ext->getOperand(0);
+	if (cmp->getPredicate() == CmpInst::ICMP_NE)
+	{
+		return cond;
+	}
+	else if (cmp->getPredicate() == CmpInst::ICMP_EQ)
+	{
+		// (A compare that's only used here can just be inverted)
+		ICmpInst* inner = dyn_cast<ICmpInst>(cond);
+		if (inner != nullptr && inner->hasOneUse() && ext->hasOneUse())
+		{
+			inner->setPredicate(inner->getInversePredicate());
+			return inner;
+		}
+
+		IRBuilder<> build(cmp);
+		return build.CreateNot(cond, cmp->getName());
+	}
+
+	return nullptr;
+}
+
+} // opt
+} // uscc
+
+char uscc::opt::Peephole::ID = 0;
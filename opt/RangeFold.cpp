@@ -0,0 +1,139 @@
+//
+//  RangeFold.cpp
+//  uscc
+//
+//  Implements the Range Folding opt pass.
+//  This uses the Value Range analysis to fold the compares
+//  (and so the branches) that the ranges decide, such as a
+//  test that a dominating test already made, and marks the
+//  arithmetic that can't overflow as nsw.
+//
+//---------------------------------------------------------
+//  Copyright (c) 2014, Sanjay Madhav
+//  All rights reserved.
+//
+//  This file is distributed under the BSD license.
+//  See LICENSE.TXT for details.
+//---------------------------------------------------------
+#include "Passes.h"
+#include "../parse/TimeTrace.h"
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wconversion"
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Constants.h>
+#pragma clang diagnostic pop
+
+using namespace llvm;
+
+namespace uscc
+{
+namespace opt
+{
+
+bool RangeFold::runOnFunction(Function& F)
+{
+	parse::TimeScope timer("RangeFold", F.getName());
+
+	ValueRange& ranges = getAnalysis<ValueRange>();
+
+	bool changed = false;
+	for (BasicBlock& block : F)
+	{
+		BasicBlock::iterator instrIter = block.begin();
+		while (instrIter != block.end())
+		{
+			Instruction* instr = instrIter;
+			++instrIter;
+
+			if (ICmpInst* cmp = dyn_cast<ICmpInst>(instr))
+			{
+				int result = ValueRange::getCompareResult(cmp->getPredicate(),
+					ranges.getRangeAt(cmp->getOperand(0), &block),
+					ranges.getRangeAt(cmp->getOperand(1), &block));
+				if (result != -1)
+				{
+					cmp->replaceAllUsesWith(ConstantInt::get(cmp->getType(), result));
+					cmp->eraseFromParent();
+					changed = true;
+				}
+			}
+			else if (isa<BinaryOperator>(instr))
+			{
+				changed |= markNoWrap(cast<BinaryOperator>(instr), ranges);
+			}
+		}
+
+		changed |= foldBranch(&block);
+	}
+
+	return changed;
+}
+
+void RangeFold::getAnalysisUsage(AnalysisUsage& Info) const
+{
+	// (This folds branches, so the CFG isn't preserved)
+	Info.addRequired<ValueRange>();
+}
+
+// Marks an add, sub or mul whose result is always in range as nsw
+bool RangeFold::markNoWrap(BinaryOperator* binOp, ValueRange& ranges)
+{
+	unsigned opcode = binOp->getOpcode();
+	if ((opcode != Instruction::Add && opcode != Instruction::Sub &&
+		 opcode != Instruction::Mul) || binOp->hasNoSignedWrap() ||
+		binOp->getType()->getIntegerBitWidth() > 32)
+	{
+		return false;
+	}
+
+	BasicBlock* block = binOp->getParent();
+	ValueRange::Range lhs = ranges.getRangeAt(binOp->getOperand(0), block);
+	ValueRange::Range rhs = ranges.getRangeAt(binOp->getOperand(1), block);
+	if (lhs.isEmpty() || rhs.isEmpty())
+	{
+		return false;
+	}
+
+	ValueRange::Range exact = ValueRange::getExactRange(opcode, lhs, rhs);
+	ValueRange::Range full = ValueRange::getFullRange(binOp->getType());
+	if (exact.isEmpty() || exact.mLo < full.mLo || exact.mHi > full.mHi)
+	{
+		return false;
+	}
+
+	binOp->setHasNoSignedWrap(true);
+	return true;
+}
+
+// If the block's branch now has a constant condition, replaces it with
+// a branch to the successor that's taken (the other one may be left
+// unreachable, which DeadBlocks removes)
+bool RangeFold::foldBranch(BasicBlock* block)
+{
+	BranchInst* branch = dyn_cast<BranchInst>(block->getTerminator());
+	if (branch == nullptr || branch->isUnconditional() ||
+		branch->getSuccessor(0) == branch->getSuccessor(1))
+	{
+		return false;
+	}
+
+	ConstantInt* cond = dyn_cast<ConstantInt>(branch->getCondition());
+	if (cond == nullptr)
+	{
+		return false;
+	}
+
+	// (Successor 0 is taken if the condition is true)
+	BasicBlock* taken = branch->getSuccessor(cond->isOne() ? 0 : 1);
+	BasicBlock* notTaken = branch->getSuccessor(cond->isOne() ? 1 : 0);
+	notTaken->removePredecessor(block);
+	BranchInst::Create(taken, block);
+	branch->eraseFromParent();
+	return true;
+}
+
+} // opt
+} // uscc
+
+char uscc::opt::RangeFold::ID = 0;
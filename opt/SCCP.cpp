@@ -0,0 +1,376 @@
+//
+//  SCCP.cpp
+//  uscc
+//
+//  Implements the Sparse Conditional Constant Propagation
+//  opt pass (Wegman and Zadeck). Values are only evaluated
+//  along the edges that can be taken, so constants flow
+//  through phis and folded branches in a single run.
+//
+//---------------------------------------------------------
+//  Copyright (c) 2014, Sanjay Madhav
+//  All rights reserved.
+//
+//  This file is distributed under the BSD license.
+//  See LICENSE.TXT for details.
+//---------------------------------------------------------
+#include "Passes.h"
+#include "../parse/TimeTrace.h"
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wconversion"
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Constants.h>
+#pragma clang diagnostic pop
+
+using namespace llvm;
+
+namespace uscc
+{
+namespace opt
+{
+
+bool SCCP::runOnFunction(Function& F)
+{
+	parse::TimeScope timer("SCCP", F.getName());
+
+	mValues.clear();
+	mExecBlocks.clear();
+	mExecEdges.clear();
+	mBlockWorklist.clear();
+	mInstrWorklist.clear();
+
+	// Solve for the values that are constant along the executable edges
+	markBlockExecutable(&F.getEntryBlock());
+	while (!mBlockWorklist.empty() || !mInstrWorklist.empty())
+	{
+		// (Instructions are done first, since there are usually fewer of them)
+		while (!mInstrWorklist.empty())
+		{
+			Instruction* instr = mInstrWorklist.back();
+			mInstrWorklist.pop_back();
+			if (isBlockExecutable(instr->getParent()))
+			{
+				visitInstr(instr);
+			}
+		}
+
+		while (!mBlockWorklist.empty())
+		{
+			BasicBlock* block = mBlockWorklist.back();
+			mBlockWorklist.pop_back();
+			for (Instruction& instr : *block)
+			{
+				visitInstr(&instr);
+			}
+		}
+	}
+
+	// Now replace the constants. The branches that can't be taken are
+	// left for DeadBlocks, which asks this pass for the executable edges.
+	bool changed = false;
+	for (BasicBlock& block : F)
+	{
+		if (!isBlockExecutable(&block))
+		{
+			continue;
+		}
+
+		BasicBlock::iterator instrIter = block.begin();
+		while (instrIter != block.end())
+		{
+			Instruction* instr = instrIter;
+			++instrIter;
+
+			auto iter = mValues.find(instr);
+			if (iter != mValues.end() && iter->second.mState == LatticeVal::Const)
+			{
+				instr->replaceAllUsesWith(iter->second.mConst);
+				instr->eraseFromParent();
+				changed = true;
+			}
+		}
+	}
+
+	// (The erased instructions can't be looked up anymore)
+	mValues.clear();
+
+	return changed;
+}
+
+void SCCP::getAnalysisUsage(AnalysisUsage& Info) const
+{
+	// This only replaces instructions with constants
+	// (DeadBlocks changes the branches)
+	Info.setPreservesCFG();
+}
+
+// Returns true if the block can execute
+// (for the function this pass was last run on)
+bool SCCP::isBlockExecutable(BasicBlock* block) const
+{
+	return mExecBlocks.count(block) != 0;
+}
+
+// Returns true if the edge can be taken
+// (for the function this pass was last run on)
+bool SCCP::isEdgeExecutable(BasicBlock* from, BasicBlock* to) const
+{
+	return mExecEdges.count(std::make_pair(from, to)) != 0;
+}
+
+// Returns the current lattice value of this value
+SCCP::LatticeVal SCCP::getValue(Value* value) const
+{
+	LatticeVal result;
+	if (ConstantInt* constant = dyn_cast<ConstantInt>(value))
+	{
+		result.mState = LatticeVal::Const;
+		result.mConst = constant;
+	}
+	else if (isa<Instruction>(value))
+	{
+		auto iter = mValues.find(value);
+		if (iter != mValues.end())
+		{
+			result = iter->second;
+		}
+	}
+	else
+	{
+		// Arguments, globals and undef could be anything
+		result.mState = LatticeVal::Overdefined;
+	}
+
+	return result;
+}
+
+// Lowers the instruction to a constant, and revisits its users if it changed
+void SCCP::markConstant(Instruction* instr, ConstantInt* constant)
+{
+	LatticeVal& value = mValues[instr];
+	if (value.mState == LatticeVal::Const && value.mConst == constant)
+	{
+		return;
+	}
+
+	// A constant that changes isn't one
+	if (value.mState != LatticeVal::Unknown)
+	{
+		markOverdefined(instr);
+		return;
+	}
+
+	value.mState = LatticeVal::Const;
+	value.mConst = constant;
+	pushUsers(instr);
+}
+
+// Lowers the instruction to overdefined, and revisits its users if it changed
+void SCCP::markOverdefined(Instruction* instr)
+{
+	LatticeVal& value = mValues[instr];
+	if (value.mState == LatticeVal::Overdefined)
+	{
+		return;
+	}
+
+	value.mState = LatticeVal::Overdefined;
+	value.mConst = nullptr;
+	pushUsers(instr);
+}
+
+// Lowers the instruction to the value of the (folded) constant
+// (If it didn't fold to an integer, the instruction is overdefined)
+void SCCP::markFolded(Instruction* instr, Constant* folded)
+{
+	ConstantInt* constant = dyn_cast<ConstantInt>(folded);
+	if (constant != nullptr)
+	{
+		markConstant(instr, constant);
+	}
+	else
+	{
+		// (Such as division by zero, which must still happen at run time)
+		markOverdefined(instr);
+	}
+}
+
+void SCCP::pushUsers(Instruction* instr)
+{
+	for (User* user : instr->users())
+	{
+		mInstrWorklist.push_back(cast<Instruction>(user));
+	}
+}
+
+void SCCP::markBlockExecutable(BasicBlock* block)
+{
+	if (!isBlockExecutable(block))
+	{
+		mExecBlocks.insert(block);
+		mBlockWorklist.push_back(block);
+	}
+}
+
+// Marks the edge as executable. If the block was already executable,
+// only its phis need to be revisited (for the new incoming value).
+void SCCP::markEdgeExecutable(BasicBlock* from, BasicBlock* to)
+{
+	std::pair<BasicBlock*, BasicBlock*> edge(from, to);
+	if (mExecEdges.count(edge) != 0)
+	{
+		return;
+	}
+	mExecEdges.insert(edge);
+
+	if (!isBlockExecutable(to))
+	{
+		markBlockExecutable(to);
+	}
+	else
+	{
+		for (BasicBlock::iterator iter = to->begin(); isa<PHINode>(iter); ++iter)
+		{
+			mInstrWorklist.push_back(iter);
+		}
+	}
+}
+
+// Evaluates the instruction with the current values of its operands
+void SCCP::visitInstr(Instruction* instr)
+{
+	if (PHINode* phi = dyn_cast<PHINode>(instr))
+	{
+		visitPhi(phi);
+	}
+	else if (BranchInst* branch = dyn_cast<BranchInst>(instr))
+	{
+		visitBranch(branch);
+	}
+	else if (isa<BinaryOperator>(instr) || isa<ICmpInst>(instr))
+	{
+		LatticeVal lhs = getValue(instr->getOperand(0));
+		LatticeVal rhs = getValue(instr->getOperand(1));
+		if (lhs.mState == LatticeVal::Overdefined || rhs.mState == LatticeVal::Overdefined)
+		{
+			markOverdefined(instr);
+		}
+		else if (lhs.mState == LatticeVal::Const && rhs.mState == LatticeVal::Const)
+		{
+			if (ICmpInst* cmp = dyn_cast<ICmpInst>(instr))
+			{
+				markFolded(instr, ConstantExpr::getICmp(cmp->getPredicate(),
+														lhs.mConst, rhs.mConst));
+			}
+			else
+			{
+				markFolded(instr, ConstantExpr::get(instr->getOpcode(),
+													lhs.mConst, rhs.mConst));
+			}
+		}
+	}
+	else if (isa<SExtInst>(instr) || isa<ZExtInst>(instr) || isa<TruncInst>(instr))
+	{
+		LatticeVal operand = getValue(instr->getOperand(0));
+		if (operand.mState == LatticeVal::Overdefined)
+		{
+			markOverdefined(instr);
+		}
+		else if (operand.mState == LatticeVal::Const)
+		{
+			markFolded(instr, ConstantExpr::getCast(instr->getOpcode(), operand.mConst,
+													instr->getType()));
+		}
+	}
+	else if (SelectInst* select = dyn_cast<SelectInst>(instr))
+	{
+		LatticeVal cond = getValue(select->getCondition());
+		if (cond.mState == LatticeVal::Const)
+		{
+			Value* chosen = cond.mConst->isOne() ? select->getTrueValue() : select->getFalseValue();
+			LatticeVal value = getValue(chosen);
+			if (value.mState == LatticeVal::Const)
+			{
+				markConstant(instr, value.mConst);
+			}
+			else if (value.mState == LatticeVal::Overdefined)
+			{
+				markOverdefined(instr);
+			}
+		}
+		else if (cond.mState == LatticeVal::Overdefined)
+		{
+			markOverdefined(instr);
+		}
+	}
+	else if (!instr->getType()->isVoidTy())
+	{
+		// Loads, calls and everything else can't be evaluated here
+		markOverdefined(instr);
+	}
+}
+
+// A phi is the meet of its values along the executable incoming edges
+void SCCP::visitPhi(PHINode* phi)
+{
+	if (getValue(phi).mState == LatticeVal::Overdefined)
+	{
+		return;
+	}
+
+	ConstantInt* constant = nullptr;
+	for (unsigned i = 0; i < phi->getNumIncomingValues(); i++)
+	{
+		if (!isEdgeExecutable(phi->getIncomingBlock(i), phi->getParent()))
+		{
+			continue;
+		}
+
+		LatticeVal value = getValue(phi->getIncomingValue(i));
+		if (value.mState == LatticeVal::Overdefined ||
+			(value.mState == LatticeVal::Const && constant != nullptr &&
+			 value.mConst != constant))
+		{
+			markOverdefined(phi);
+			return;
+		}
+		else if (value.mState == LatticeVal::Const)
+		{
+			constant = value.mConst;
+		}
+	}
+
+	if (constant != nullptr)
+	{
+		markConstant(phi, constant);
+	}
+}
+
+// Marks the successors the branch can go to as executable
+void SCCP::visitBranch(BranchInst* branch)
+{
+	BasicBlock* block = branch->getParent();
+	if (branch->isUnconditional())
+	{
+		markEdgeExecutable(block, branch->getSuccessor(0));
+		return;
+	}
+
+	LatticeVal cond = getValue(branch->getCondition());
+	if (cond.mState == LatticeVal::Const)
+	{
+		// (Successor 0 is taken if the condition is true)
+		markEdgeExecutable(block, branch->getSuccessor(cond.mConst->isOne() ? 0 : 1));
+	}
+	else if (cond.mState == LatticeVal::Overdefined)
+	{
+		markEdgeExecutable(block, branch->getSuccessor(0));
+		markEdgeExecutable(block, branch->getSuccessor(1));
+	}
+}
+
+} // opt
+} // uscc
+
+char uscc::opt::SCCP::ID = 0;
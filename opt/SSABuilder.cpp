@@ -14,6 +14,7 @@
 
 #include "SSABuilder.h"
 #include "../parse/Symbols.h"
+#include "../parse/MemReport.h"
 
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wconversion"
@@ -27,31 +28,45 @@
 #include <llvm/IR/Constants.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/CFG.h>
+#include <llvm/ADT/SmallPtrSet.h>
 #include <llvm/IR/Constants.h>
 #pragma clang diagnostic pop
 
-#include <list>
+#include <algorithm>
+#include <cassert>
+#include <iterator>
 
 using namespace uscc::opt;
 using namespace uscc::parse;
 using namespace llvm;
 
+SSABuilder::SSABuilder()
+: mEpoch(0)
+, mLastBlock(nullptr)
+, mLastBlockId(0)
+{
+	
+}
+
 // Called when a new function is started to clear out all the data
 void SSABuilder::reset()
 {
 	// PA4: Implement
     
-    for (auto & val : mVarDefs) {
-        delete val.second;
-    }
-    mVarDefs.clear();
-    
-    for (auto & val : mIncompletePhis) {
-        delete val.second;
-    }
-    mIncompletePhis.clear();
-    
-    mSealedBlocks.clear();
+    // Everything is in the arena, so this doesn't depend on the
+    // size of the last function
+    mArena.Reset();
+    mBlockIds.clear();
+    mVarIds.clear();
+    mBlocks.clear();
+    mSealed.clear();
+    mDefs.clear();
+    mPhiDefs.clear();
+    mFrames.clear();
+    mPreds.clear();
+    mEpoch = 0;
+    mLastBlock = nullptr;
+    mLastBlockId = 0;
 }
 
 // For a specific variable in a specific basic block, write its value
@@ -59,8 +74,17 @@ void SSABuilder::writeVariable(Identifier* var, BasicBlock* block, Value* value)
 {
 	// PA4: Implement
 
-    SubMap * myVarMap = mVarDefs[block];
-    (*myVarMap)[var] = value;
+    bool inserted;
+    uint64_t key = getDefKey(getBlockId(block), getVarId(var));
+    mDefs.insert(mArena, key, inserted) = value;
+    if (inserted) {
+        MemReport::get().add(MemReport::SSAEntries, sizeof(uint64_t) + sizeof(Value*));
+    }
+    
+    // Remember where phis are written, in case they're removed
+    if (PHINode* phi = dyn_cast<PHINode>(value)) {
+        addPhiDef(phi, key);
+    }
 }
 
 // Read the value assigned to the variable in the requested basic block
@@ -69,11 +93,10 @@ Value* SSABuilder::readVariable(Identifier* var, BasicBlock* block)
 {
 	// PA4: Implement
     
-    SubMap * myVarMap = mVarDefs[block];
-    
     // check if variable is in current block
-    if (myVarMap->find(var) != myVarMap->end()) {
-        return myVarMap->at(var);
+    Value** def = mDefs.find(getDefKey(getBlockId(block), getVarId(var)));
+    if (def != nullptr) {
+        return *def;
     }
 	
 	return readVariableRecursive(var, block);
@@ -84,8 +107,15 @@ void SSABuilder::addBlock(BasicBlock* block, bool isSealed /* = false */)
 {
 	// PA4: Implement
     
-    mVarDefs.insert({block, new SubMap});
-    mIncompletePhis.insert({block, new SubPHI});
+    bool inserted;
+    unsigned& id = mBlockIds.insert(mArena, reinterpret_cast<uintptr_t>(block), inserted);
+    if (inserted) {
+        id = mBlocks.size();
+        mBlocks.push_back(mArena).mBlock = block;
+        if (id % 64 == 0) {
+            mSealed.push_back(mArena);
+        }
+    }
     
     if (isSealed) {
         sealBlock(block);
@@ -98,92 +128,274 @@ void SSABuilder::sealBlock(llvm::BasicBlock* block)
 {
 	// PA4: Implement
     
-    SubPHI* mySubPhi = mIncompletePhis[block];
-    for (auto it = mySubPhi->begin(), E = mySubPhi->end(); it != E; ++it) {
-        addPhiOperands(it->first, it->second);
+    unsigned id = getBlockId(block);
+    
+    // (Completing a phi can add more incomplete phis to this block,
+    // which are appended to the list and completed too)
+    for (IncompletePhi* incomplete = mBlocks[id].mFirstPhi; incomplete != nullptr;
+         incomplete = incomplete->mNext) {
+        addPhiOperands(incomplete->mVar, incomplete->mPhi);
     }
-    mSealedBlocks.insert(block);
+    mSealed[id / 64] |= (uint64_t(1) << (id % 64));
+}
+
+// This is called for a loop header (before it's sealed) with the sorted
+// variables that may be assigned in the loop. The other variables have
+// the same value as on entry, so reading them won't create a phi.
+void SSABuilder::setAssigned(BasicBlock* block, const std::vector<Identifier*>& vars)
+{
+    mBlocks[getBlockId(block)].mAssigned = &vars;
 }
 
-// Recursively search predecessor blocks for a variable
+// Returns the number of a block that was added with addBlock
+unsigned SSABuilder::getBlockId(BasicBlock* block)
+{
+    if (block != mLastBlock) {
+        unsigned* id = mBlockIds.find(reinterpret_cast<uintptr_t>(block));
+        assert(id != nullptr && "Block wasn't added to the SSABuilder");
+        mLastBlock = block;
+        mLastBlockId = *id;
+    }
+    return mLastBlockId;
+}
+
+// Returns the number of a variable (numbering it, if it's new)
+unsigned SSABuilder::getVarId(Identifier* var)
+{
+    bool inserted;
+    unsigned& id = mVarIds.insert(mArena, reinterpret_cast<uintptr_t>(var), inserted);
+    if (inserted) {
+        id = mVarIds.size() - 1;
+    }
+    return id;
+}
+
+// Search predecessor blocks for a variable
+// (This is iterative, so a long chain of blocks can't overflow the stack)
 Value* SSABuilder::readVariableRecursive(Identifier* var, BasicBlock* block)
 {
-	Value* retVal = nullptr;
-	
 	// PA4: Implement
     
-    // count predecessors
-    int predCount = 0;
-    for (pred_iterator PI = pred_begin(block), E = pred_end(block); PI != E; ++PI) {
-        ++predCount;
-    }
-    
-    // 3 Cases
+    return runFrames(var, block, mFrames.size());
+}
+
+// Adds phi operands based on predecessors of the containing block
+Value* SSABuilder::addPhiOperands(Identifier* var, PHINode* phi)
+{
+	// PA4: Implement
+	
+    size_t base = mFrames.size();
+    pushPhiFrame(phi->getParent(), phi);
+    return runFrames(var, nullptr, base);
+}
+
+// Reads the variable starting at block (if it's non-null), and then
+// finishes all the frames above base. Returns the value of the last
+// frame that was finished (or the value read, if there were none).
+Value* SSABuilder::runFrames(Identifier* var, BasicBlock* block, size_t base)
+{
+    unsigned varId = getVarId(var);
     
-    // Case 1: Block is not sealed
-    if (mSealedBlocks.find(block) == mSealedBlocks.end()) {
-        llvm::PHINode * phi;
-        if (block->empty()) {
-            phi = PHINode::Create(var->llvmType(), 0, var->getName(), block);
-        }
-        else {
-            phi = PHINode::Create(var->llvmType(), 0, var->getName(), &block->front());
+    Value* result = nullptr;
+    bool haveResult = false;
+    for (;;) {
+        // Single predecessor blocks seen during this walk are marked, so
+        // an (unreachable) cycle of them doesn't loop forever. (A block
+        // marked by an earlier walk may still be waiting for its value,
+        // so this walk has to go past it, to the phi that was written.)
+        mEpoch++;
+        
+        // Walk up the predecessors until there is a value, or a phi
+        // is needed (whose operands are read one at a time below)
+        while (block != nullptr) {
+            unsigned id = getBlockId(block);
+            Value** def = mDefs.find(getDefKey(id, varId));
+            
+            // Case 0: The variable was written in this block
+            if (def != nullptr) {
+                result = *def;
+                haveResult = true;
+                break;
+            }
+            
+            pred_iterator PI = pred_begin(block), E = pred_end(block);
+            
+            // Case 1: Block is not sealed
+            // (Unless the variable can't change in the loop, in which
+            // case the entry edge is its only predecessor that matters)
+            const std::vector<Identifier*>* assigned = mBlocks[id].mAssigned;
+            if (!isSealed(id) &&
+                (assigned == nullptr || PI == E || std::next(PI) != E ||
+                 std::binary_search(assigned->begin(), assigned->end(), var))) {
+                PHINode* phi = createPhi(var, block, 0);
+                IncompletePhi* incomplete = new (mArena.Allocate<IncompletePhi>()) IncompletePhi();
+                incomplete->mVar = var;
+                incomplete->mPhi = phi;
+                BlockInfo& info = mBlocks[id];
+                if (info.mLastPhi != nullptr) {
+                    info.mLastPhi->mNext = incomplete;
+                }
+                else {
+                    info.mFirstPhi = incomplete;
+                }
+                info.mLastPhi = incomplete;
+                MemReport::get().add(MemReport::SSAEntries, sizeof(IncompletePhi));
+                
+                writeVariable(var, block, phi);
+                result = phi;
+                haveResult = true;
+                break;
+            }
+            
+            if (mBlocks[id].mMarker == mEpoch) {
+                result = UndefValue::get(var->llvmType(block->getContext()));
+                haveResult = true;
+                break;
+            }
+            
+            if (PI != E && std::next(PI) == E) {
+                // Case 2: Block is sealed, and has only 1 predecessor
+                // (so it has the same value as its predecessor)
+                mBlocks[id].mMarker = mEpoch;
+                Frame frame;
+                frame.mBlock = block;
+                frame.mPhi = nullptr;
+                frame.mPredBegin = static_cast<unsigned>(mPreds.size());
+                frame.mNextPred = frame.mPredEnd = frame.mPredBegin;
+                mFrames.push_back(frame);
+                block = *PI;
+            }
+            else {
+                // Case 3: Block is sealed, and has multiple predecessors
+                // (The phi is written first, to break cycles)
+                unsigned predCount = static_cast<unsigned>(std::distance(PI, E));
+                PHINode* phi = createPhi(var, block, predCount);
+                writeVariable(var, block, phi);
+                pushPhiFrame(block, phi);
+                break;
+            }
         }
-        mIncompletePhis[block]->insert({var, phi});
-        retVal = phi;
-    }
-    
-    // Case 2: Block is sealed, and has only 1 predecessor
-    else if (mSealedBlocks.find(block) != mSealedBlocks.end()
-             && predCount == 1) {
-        retVal = readVariable(var, *pred_begin(block));
-    }
-    
-    // Case 3: Block is sealed, and has multiple predecessors
-    else {
-        llvm::PHINode * phi;
-        if (block->empty()) {
-            phi = PHINode::Create(var->llvmType(), predCount, var->getName(), block);
+        block = nullptr;
+        
+        // Hand the result to the frames that are waiting for it
+        while (mFrames.size() > base) {
+            Frame& frame = mFrames.back();
+            if (frame.mPhi == nullptr) {
+                writeVariable(var, frame.mBlock, result);
+                mFrames.pop_back();
+                continue;
+            }
+            
+            if (haveResult) {
+                frame.mPhi->addIncoming(result, mPreds[frame.mNextPred]);
+                frame.mNextPred++;
+                haveResult = false;
+            }
+            
+            // Read the next operand
+            if (frame.mNextPred < frame.mPredEnd) {
+                block = mPreds[frame.mNextPred];
+                break;
+            }
+            
+            // (This also replaces the phi in the definitions)
+            result = tryRemoveTrivialPhi(frame.mPhi);
+            haveResult = true;
+            mPreds.resize(frame.mPredBegin);
+            mFrames.pop_back();
         }
-        else {
-            phi = PHINode::Create(var->llvmType(), predCount, var->getName(), &block->front());
+        
+        if (block == nullptr) {
+            return result;
         }
-        retVal = phi;
-        writeVariable(var, block, retVal);
-        retVal = addPhiOperands(var, phi);
     }
-    
-    writeVariable(var, block, retVal);
-    
-	return retVal;
 }
 
-// Adds phi operands based on predecessors of the containing block
-Value* SSABuilder::addPhiOperands(Identifier* var, PHINode* phi)
+// Pushes a frame that reads the operands of the phi
+void SSABuilder::pushPhiFrame(BasicBlock* block, PHINode* phi)
 {
-	// PA4: Implement
-	
-    for (pred_iterator PI = pred_begin(phi->getParent()), E = pred_end(phi->getParent()); PI != E; ++PI) {
-        phi->addIncoming(readVariable(var, *PI), *PI);
+    Frame frame;
+    frame.mBlock = block;
+    frame.mPhi = phi;
+    frame.mPredBegin = static_cast<unsigned>(mPreds.size());
+    frame.mNextPred = frame.mPredBegin;
+    for (pred_iterator PI = pred_begin(block), E = pred_end(block); PI != E; ++PI) {
+        mPreds.push_back(*PI);
     }
-    
-	return tryRemoveTrivialPhi(phi);
+    frame.mPredEnd = static_cast<unsigned>(mPreds.size());
+    mFrames.push_back(frame);
+}
+
+// Creates an empty phi for the variable at the start of the block
+PHINode* SSABuilder::createPhi(Identifier* var, BasicBlock* block, unsigned reserve)
+{
+    llvm::PHINode * phi;
+    if (block->empty()) {
+        phi = PHINode::Create(var->llvmType(block->getContext()), reserve, var->getName(), block);
+    }
+    else {
+        phi = PHINode::Create(var->llvmType(block->getContext()), reserve, var->getName(), &block->front());
+    }
+    return phi;
 }
 
 // Removes trivial phi nodes
+// (Along with any of their users that become trivial as a result)
 Value* SSABuilder::tryRemoveTrivialPhi(llvm::PHINode* phi)
 {
-	Value* same = nullptr;
-	
 	// PA4: Implement
     
-    for (int i=0; i < phi->getNumIncomingValues(); ++i) {
+    Value* same = getTrivialValue(phi);
+    if (same == nullptr) {
+        return phi; // phi merges at least two values: not trivial
+    }
+    
+    // The phis that were removed, and what they were replaced with
+    DenseMap<PHINode*, Value*> replaced;
+    std::vector<PHINode*> worklist;
+    removePhi(phi, same, replaced, worklist);
+    
+    // try to remove all phi users, which might have become trivial
+    while (!worklist.empty()) {
+        PHINode* user = worklist.back();
+        worklist.pop_back();
+        
+        // (Phis that are still having their operands read are
+        // checked once they have all of them)
+        if (replaced.count(user) != 0 || isPending(user)) {
+            continue;
+        }
+        
+        Value* userSame = getTrivialValue(user);
+        if (userSame != nullptr) {
+            removePhi(user, userSame, replaced, worklist);
+        }
+    }
+    
+    // same might have been one of the users that was removed
+    while (PHINode* samePhi = dyn_cast<PHINode>(same)) {
+        auto iter = replaced.find(samePhi);
+        if (iter == replaced.end()) {
+            break;
+        }
+        same = iter->second;
+    }
+	
+	return same;
+}
+
+// If the phi only merges one value (besides itself), returns that
+// value (or undef, if it has no operands). Otherwise returns nullptr.
+Value* SSABuilder::getTrivialValue(PHINode* phi)
+{
+    Value* same = nullptr;
+    for (unsigned i = 0; i < phi->getNumIncomingValues(); ++i) {
         llvm::Value* op = phi->getIncomingValue(i);
         if (op == same || op == phi) {
             continue; // unique value or self-reference
         }
         if (same != nullptr) {
-            return phi; // phi merges at least two values: not trivial
+            return nullptr; // phi merges at least two values: not trivial
         }
         same = op;
     }
@@ -191,27 +403,246 @@ Value* SSABuilder::tryRemoveTrivialPhi(llvm::PHINode* phi)
     if (same == nullptr) {
         same = UndefValue::get(phi->getType()); // phi is unreachable or in start block
     }
+    return same;
+}
+
+// Replaces the phi with same everywhere and deletes it. Adds the
+// phis that used it to the worklist.
+void SSABuilder::removePhi(PHINode* phi, Value* same, DenseMap<PHINode*, Value*>& replaced,
+                           std::vector<PHINode*>& worklist)
+{
+    // The users are collected first, since the phi's use list
+    // goes away with it
+    for (Value::use_iterator UI = phi->use_begin(), E = phi->use_end(); UI != E; ++UI) {
+        PHINode* user = dyn_cast<PHINode>(UI->getUser());
+        if (user != nullptr && user != phi) {
+            worklist.push_back(user);
+        }
+    }
     
     phi->replaceAllUsesWith(same); // reroute all uses of phi to same
     
     // remove from variable map
-    for (auto MI = mVarDefs.begin(), E = mVarDefs.end(); MI != E; ++MI) {
-        SubMap* mySubMap = MI->second;
-        for (auto MI2 = mySubMap->begin(), E2 = mySubMap->end(); MI2 != E2; ++MI2) {
-            if (MI2->second == phi) {
-                MI2->second = same;
+    DefSlot** slots = mPhiDefs.find(reinterpret_cast<uintptr_t>(phi));
+    if (slots != nullptr) {
+        DefSlot* slot = *slots;
+        *slots = nullptr;
+        
+        PHINode* samePhi = dyn_cast<PHINode>(same);
+        while (slot != nullptr) {
+            DefSlot* next = slot->mNext;
+            Value** def = mDefs.find(slot->mKey);
+            // (The slot is stale if the variable was written again)
+            if (*def == phi) {
+                *def = same;
+                if (samePhi != nullptr) {
+                    // The slot now belongs to same
+                    bool inserted;
+                    DefSlot*& head = mPhiDefs.insert(mArena, reinterpret_cast<uintptr_t>(samePhi), inserted);
+                    slot->mNext = head;
+                    head = slot;
+                }
             }
+            slot = next;
         }
     }
     
+    replaced[phi] = same;
     phi->eraseFromParent(); // remove phi
+}
+
+// Records that the phi was written as the definition with this key
+void SSABuilder::addPhiDef(PHINode* phi, uint64_t key)
+{
+    bool inserted;
+    DefSlot*& head = mPhiDefs.insert(mArena, reinterpret_cast<uintptr_t>(phi), inserted);
+    if (head != nullptr && head->mKey == key) {
+        return;
+    }
     
-    // try to recursively remove all phi users, which might have become trivial
-    for (llvm::AShrOperator::use_iterator UI = phi->use_begin(), E = phi->use_end(); UI != E; ++UI) {
-        if (UI->getUser() != phi) {
-            tryRemoveTrivialPhi(cast<llvm::PHINode>(UI->getUser()));
+    DefSlot* slot = new (mArena.Allocate<DefSlot>()) DefSlot();
+    slot->mKey = key;
+    slot->mNext = head;
+    head = slot;
+    MemReport::get().add(MemReport::SSAEntries, sizeof(DefSlot));
+}
+
+// Returns true if the phi's operands are still being read
+// (which is the case for the phis in mFrames)
+bool SSABuilder::isPending(PHINode* phi)
+{
+    BasicBlock* block = phi->getParent();
+    size_t predCount = std::distance(pred_begin(block), pred_end(block));
+    return phi->getNumIncomingValues() < predCount;
+}
+
+// This is called when the function is finished. It removes the groups of
+// phis that only pass one value around between themselves, so the result
+// is minimal SSA form (section 3.2 of the paper)
+void SSABuilder::removeRedundantPhis(Function* func)
+{
+    std::vector<PHINode*> phis;
+    for (BasicBlock& block : *func) {
+        for (Instruction& instr : block) {
+            PHINode* phi = dyn_cast<PHINode>(&instr);
+            if (phi == nullptr) {
+                break; // phis are always at the start of the block
+            }
+            phis.push_back(phi);
         }
     }
-	
-	return same;
+    
+    removeRedundantPhis(phis);
+}
+
+// Removes the redundant phis in this set of phis
+void SSABuilder::removeRedundantPhis(const std::vector<PHINode*>& phis)
+{
+    std::vector<std::vector<PHINode*>> sccs;
+    computePhiSCCs(phis, sccs);
+    
+    // (The operands of a component are simplified before it is)
+    for (auto& scc : sccs) {
+        processSCC(scc);
+    }
+}
+
+// Splits the phis into the strongly connected components of the graph
+// of their phi operands (in the set). The components are ordered so
+// a component comes after the ones it has operands in.
+void SSABuilder::computePhiSCCs(const std::vector<PHINode*>& phis,
+                                std::vector<std::vector<PHINode*>>& sccs)
+{
+    // This is Tarjan's algorithm, with an explicit stack so that
+    // long chains of phis can't overflow the native one
+    struct NodeInfo
+    {
+        unsigned mIndex;
+        unsigned mLowLink;
+        bool mOnStack;
+    };
+    
+    const unsigned unvisited = ~0u;
+    DenseMap<PHINode*, NodeInfo> info;
+    for (PHINode* phi : phis) {
+        info[phi] = NodeInfo{unvisited, 0, false};
+    }
+    
+    // Each call frame is a phi and the next of its operands to visit
+    std::vector<std::pair<PHINode*, unsigned>> callStack;
+    std::vector<PHINode*> sccStack;
+    unsigned nextIndex = 0;
+    
+    for (PHINode* root : phis) {
+        if (info[root].mIndex != unvisited) {
+            continue;
+        }
+        
+        info[root] = NodeInfo{nextIndex, nextIndex, true};
+        nextIndex++;
+        sccStack.push_back(root);
+        callStack.push_back({root, 0});
+        
+        while (!callStack.empty()) {
+            PHINode* phi = callStack.back().first;
+            unsigned op = callStack.back().second;
+            
+            if (op < phi->getNumIncomingValues()) {
+                callStack.back().second++;
+                
+                // Only phis in the set are part of the graph
+                PHINode* operand = dyn_cast<PHINode>(phi->getIncomingValue(op));
+                auto iter = (operand != nullptr) ? info.find(operand) : info.end();
+                if (iter == info.end()) {
+                    continue;
+                }
+                
+                if (iter->second.mIndex == unvisited) {
+                    iter->second = NodeInfo{nextIndex, nextIndex, true};
+                    nextIndex++;
+                    sccStack.push_back(operand);
+                    callStack.push_back({operand, 0});
+                }
+                else if (iter->second.mOnStack) {
+                    NodeInfo& phiInfo = info[phi];
+                    phiInfo.mLowLink = std::min(phiInfo.mLowLink, iter->second.mIndex);
+                }
+                continue;
+            }
+            
+            // All the operands are done
+            callStack.pop_back();
+            NodeInfo phiInfo = info[phi];
+            if (!callStack.empty()) {
+                NodeInfo& parentInfo = info[callStack.back().first];
+                parentInfo.mLowLink = std::min(parentInfo.mLowLink, phiInfo.mLowLink);
+            }
+            
+            if (phiInfo.mLowLink == phiInfo.mIndex) {
+                // phi is the root of a component
+                sccs.emplace_back();
+                PHINode* member = nullptr;
+                do {
+                    member = sccStack.back();
+                    sccStack.pop_back();
+                    info[member].mOnStack = false;
+                    sccs.back().push_back(member);
+                } while (member != phi);
+            }
+        }
+    }
+}
+
+// If the component only has one operand from outside of it, replaces it
+// with that operand. Otherwise, looks for redundant phis in its inner phis.
+void SSABuilder::processSCC(const std::vector<PHINode*>& scc)
+{
+    if (scc.size() == 1) {
+        // Any trivial phis were removed as they were built, but this
+        // one might have become trivial since its operands were processed
+        PHINode* phi = scc[0];
+        Value* same = getTrivialValue(phi);
+        if (same != nullptr) {
+            phi->replaceAllUsesWith(same);
+            phi->eraseFromParent();
+        }
+        return;
+    }
+    
+    SmallPtrSet<PHINode*, 8> members(scc.begin(), scc.end());
+    
+    // The phis with all their operands in the component are inner,
+    // and the ones with operands from outside of it are on the boundary
+    std::vector<PHINode*> inner;
+    SmallPtrSet<Value*, 4> outerOps;
+    for (PHINode* phi : scc) {
+        bool isInner = true;
+        for (unsigned i = 0; i < phi->getNumIncomingValues(); ++i) {
+            Value* op = phi->getIncomingValue(i);
+            PHINode* opPhi = dyn_cast<PHINode>(op);
+            if (opPhi == nullptr || members.count(opPhi) == 0) {
+                outerOps.insert(op);
+                isInner = false;
+            }
+        }
+        
+        if (isInner) {
+            inner.push_back(phi);
+        }
+    }
+    
+    if (outerOps.size() == 1) {
+        // The whole component is just that one value
+        Value* same = *outerOps.begin();
+        for (PHINode* phi : scc) {
+            phi->replaceAllUsesWith(same);
+        }
+        for (PHINode* phi : scc) {
+            phi->eraseFromParent();
+        }
+    }
+    else if (outerOps.size() > 1) {
+        // The inner phis might still form redundant components
+        removeRedundantPhis(inner);
+    }
 }
@@ -14,13 +14,22 @@
 //---------------------------------------------------------
 
 #pragma once
-#include <unordered_map>
-#include <unordered_set>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wconversion"
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/Support/Allocator.h>
+#pragma clang diagnostic pop
 
 // LLVM forward-declarations
 namespace llvm
 {
 	class BasicBlock;
+	class Function;
 	class Value;
 	class PHINode;
 }
@@ -31,7 +40,7 @@ namespace parse
 {
 	class Identifier;
 }
-	
+
 namespace opt
 {
 
@@ -42,47 +51,348 @@ namespace opt
 class SSABuilder
 {
 public:
+	SSABuilder();
+
 	// Called when a new function is started to clear out all the data
 	void reset();
-	
+
 	// For a specific variable in a specific basic block, write its value
 	void writeVariable(parse::Identifier* var, llvm::BasicBlock* block, llvm::Value* value);
-	
+
 	// Read the value assigned to the variable in the requested basic block
 	// Will recursively search predecessor blocks if it was not written in this block
 	llvm::Value* readVariable(parse::Identifier* var, llvm::BasicBlock* block);
-	
+
 	// This is called to add a new block to the maps
 	// If the block is sealed, will automatically call "seal block" on it
 	void addBlock(llvm::BasicBlock* block, bool isSealed = false);
-	
+
 	// This is called when a block is "sealed" which means it will not have any
 	// further predecessors added. It will complete any PHI nodes (if necessary)
 	void sealBlock(llvm::BasicBlock* block);
+	
+	// This is called for a loop header (before it's sealed) with the sorted
+	// variables that may be assigned in the loop. The other variables have
+	// the same value as on entry, so reading them won't create a phi.
+	// (The vector has to outlive the function's construction.)
+	void setAssigned(llvm::BasicBlock* block, const std::vector<parse::Identifier*>& vars);
+
+	// This is called when the function is finished. It removes the groups of
+	// phis that only pass one value around between themselves, so the result
+	// is minimal SSA form (section 3.2 of the paper)
+	void removeRedundantPhis(llvm::Function* func);
 private:
 	// Helper functions
-	
-	// Recursively search predecessor blocks for a variable
+
+	// Search predecessor blocks for a variable
+	// (This is iterative, so a long chain of blocks can't overflow the stack)
 	llvm::Value* readVariableRecursive(parse::Identifier* var, llvm::BasicBlock* block);
-	
+
 	// Adds phi operands based on predecessors of the containing block
     llvm::Value* addPhiOperands(parse::Identifier* var, llvm::PHINode* phi);
-	
+
+	// Reads the variable starting at block (if it's non-null), and then
+	// finishes all the frames above base. Returns the value of the last
+	// frame that was finished (or the value read, if there were none).
+	llvm::Value* runFrames(parse::Identifier* var, llvm::BasicBlock* block, size_t base);
+
+	// Pushes a frame that reads the operands of the phi
+	void pushPhiFrame(llvm::BasicBlock* block, llvm::PHINode* phi);
+
+	// Creates an empty phi for the variable at the start of the block
+	llvm::PHINode* createPhi(parse::Identifier* var, llvm::BasicBlock* block, unsigned reserve);
+
 	// Removes trivial phi nodes
+	// (Along with any of their users that become trivial as a result)
 	llvm::Value* tryRemoveTrivialPhi(llvm::PHINode* phi);
-	
-	typedef std::unordered_map<parse::Identifier*, llvm::Value*> SubMap;
-	typedef std::unordered_map<parse::Identifier*, llvm::PHINode*> SubPHI;
-	
-	// This stores the variable definitions for a particular basic block
-	std::unordered_map<llvm::BasicBlock*, SubMap*> mVarDefs;
-	
-	// This stores any incomplete PHI nodes
-	std::unordered_map<llvm::BasicBlock*, SubPHI*> mIncompletePhis;
-	
-	// Set of all the sealed blocks in the current function
-	std::unordered_set<llvm::BasicBlock*> mSealedBlocks;
+
+	// If the phi only merges one value (besides itself), returns that
+	// value (or undef, if it has no operands). Otherwise returns nullptr.
+	llvm::Value* getTrivialValue(llvm::PHINode* phi);
+
+	// Replaces the phi with same everywhere and deletes it. Adds the
+	// phis that used it to the worklist.
+	void removePhi(llvm::PHINode* phi, llvm::Value* same,
+				   llvm::DenseMap<llvm::PHINode*, llvm::Value*>& replaced,
+				   std::vector<llvm::PHINode*>& worklist);
+
+	// Records that the phi was written as the definition with this key
+	void addPhiDef(llvm::PHINode* phi, uint64_t key);
+
+	// Returns true if the phi's operands are still being read
+	// (which is the case for the phis in mFrames)
+	bool isPending(llvm::PHINode* phi);
+
+	// Removes the redundant phis in this set of phis
+	void removeRedundantPhis(const std::vector<llvm::PHINode*>& phis);
+
+	// Splits the phis into the strongly connected components of the graph
+	// of their phi operands (in the set). The components are ordered so
+	// a component comes after the ones it has operands in.
+	void computePhiSCCs(const std::vector<llvm::PHINode*>& phis,
+						std::vector<std::vector<llvm::PHINode*>>& sccs);
+
+	// If the component only has one operand from outside of it, replaces it
+	// with that operand. Otherwise, looks for redundant phis in its inner phis.
+	void processSCC(const std::vector<llvm::PHINode*>& scc);
+
+	// Returns the number of a block that was added with addBlock
+	unsigned getBlockId(llvm::BasicBlock* block);
+
+	// Returns the number of a variable (numbering it, if it's new)
+	unsigned getVarId(parse::Identifier* var);
+
+	bool isSealed(unsigned blockId) const
+	{
+		return (mSealed[blockId / 64] >> (blockId % 64)) & 1;
+	}
+
+	// The key for a definition in mDefs
+	static uint64_t getDefKey(unsigned blockId, unsigned varId)
+	{
+		// (+1 because a key of 0 marks an empty slot)
+		return (static_cast<uint64_t>(blockId + 1) << 32) | varId;
+	}
+
+	// An open-addressing hash table (with linear probing) from nonzero
+	// 64-bit keys to values, allocated out of the builder's arena
+	template <typename T>
+	class Table
+	{
+	public:
+		Table() : mEntries(nullptr), mCapacity(0), mSize(0) { }
+
+		// Forgets the entries (the memory belongs to the arena)
+		void clear()
+		{
+			mEntries = nullptr;
+			mCapacity = 0;
+			mSize = 0;
+		}
+
+		unsigned size() const
+		{
+			return mSize;
+		}
+
+		// Returns the value for the key, or nullptr if there isn't one
+		T* find(uint64_t key) const
+		{
+			if (mCapacity == 0)
+			{
+				return nullptr;
+			}
+
+			for (unsigned i = hash(key);; i = (i + 1) & (mCapacity - 1))
+			{
+				if (mEntries[i].mKey == key)
+				{
+					return &mEntries[i].mValue;
+				}
+				else if (mEntries[i].mKey == 0)
+				{
+					return nullptr;
+				}
+			}
+		}
+
+		// Returns the value for the key, and adds a zeroed one
+		// if there isn't one (in which case inserted is set)
+		T& insert(llvm::BumpPtrAllocator& arena, uint64_t key, bool& inserted)
+		{
+			// Keep the table at most 3/4 full
+			if ((mSize + 1) * 4 > mCapacity * 3)
+			{
+				grow(arena);
+			}
+
+			unsigned i = hash(key);
+			while (mEntries[i].mKey != 0 && mEntries[i].mKey != key)
+			{
+				i = (i + 1) & (mCapacity - 1);
+			}
+
+			inserted = (mEntries[i].mKey == 0);
+			if (inserted)
+			{
+				mEntries[i].mKey = key;
+				mSize++;
+			}
+			return mEntries[i].mValue;
+		}
+
+	private:
+		struct Entry
+		{
+			uint64_t mKey;
+			T mValue;
+		};
+
+		unsigned hash(uint64_t key) const
+		{
+			// Fibonacci hashing, so pointers that only differ in
+			// their high bits still spread out
+			return static_cast<unsigned>((key * 0x9E3779B97F4A7C15ULL) >> 32) & (mCapacity - 1);
+		}
+
+		void grow(llvm::BumpPtrAllocator& arena)
+		{
+			Entry* oldEntries = mEntries;
+			unsigned oldCapacity = mCapacity;
+
+			mCapacity = (mCapacity == 0) ? 16 : mCapacity * 2;
+			mEntries = static_cast<Entry*>(arena.Allocate(sizeof(Entry) * mCapacity,
+														  alignof(Entry)));
+			std::memset(mEntries, 0, sizeof(Entry) * mCapacity);
+			mSize = 0;
+
+			// (The old entries are left in the arena until the reset)
+			for (unsigned i = 0; i < oldCapacity; i++)
+			{
+				if (oldEntries[i].mKey != 0)
+				{
+					bool inserted;
+					insert(arena, oldEntries[i].mKey, inserted) = oldEntries[i].mValue;
+				}
+			}
+		}
+
+		Entry* mEntries;
+		unsigned mCapacity;
+		unsigned mSize;
+	};
+
+	// A growable array of trivially copyable elements,
+	// allocated out of the builder's arena
+	template <typename T>
+	class Array
+	{
+	public:
+		Array() : mData(nullptr), mSize(0), mCapacity(0) { }
+
+		// Forgets the elements (the memory belongs to the arena)
+		void clear()
+		{
+			mData = nullptr;
+			mSize = 0;
+			mCapacity = 0;
+		}
+
+		unsigned size() const
+		{
+			return mSize;
+		}
+
+		T& operator[](unsigned index)
+		{
+			return mData[index];
+		}
+
+		const T& operator[](unsigned index) const
+		{
+			return mData[index];
+		}
+
+		// Adds a zeroed element to the end
+		T& push_back(llvm::BumpPtrAllocator& arena)
+		{
+			if (mSize == mCapacity)
+			{
+				mCapacity = (mCapacity == 0) ? 16 : mCapacity * 2;
+				T* data = static_cast<T*>(arena.Allocate(sizeof(T) * mCapacity, alignof(T)));
+				if (mSize != 0)
+				{
+					std::memcpy(data, mData, sizeof(T) * mSize);
+				}
+				mData = data;
+			}
+
+			std::memset(&mData[mSize], 0, sizeof(T));
+			return mData[mSize++];
+		}
+	private:
+		T* mData;
+		unsigned mSize;
+		unsigned mCapacity;
+	};
+
+	// A phi that's waiting for its block to be sealed
+	struct IncompletePhi
+	{
+		parse::Identifier* mVar;
+		llvm::PHINode* mPhi;
+		IncompletePhi* mNext;
+	};
+
+	struct BlockInfo
+	{
+		llvm::BasicBlock* mBlock;
+		// Set to mEpoch when a walk up the predecessors passes through this block
+		unsigned mMarker;
+		// Incomplete phis are kept in the order they were created, so
+		// the order they are completed in doesn't depend on pointer values
+		IncompletePhi* mFirstPhi;
+		IncompletePhi* mLastPhi;
+		// The variables that may be assigned before a back edge
+		// to this block (nullptr if they're unknown)
+		const std::vector<parse::Identifier*>* mAssigned;
+	};
+
+	// One of the definitions a phi was written to
+	struct DefSlot
+	{
+		uint64_t mKey;
+		DefSlot* mNext;
+	};
+
+	// A block that's waiting for the value of the variable in its
+	// predecessors, which replaces a level of recursion in the paper
+	struct Frame
+	{
+		llvm::BasicBlock* mBlock;
+		// The phi whose operands are being read, or nullptr if the
+		// block has one predecessor (and so the same value as it)
+		llvm::PHINode* mPhi;
+		// The range of mPreds with the block's predecessors, and
+		// the one whose value is being read
+		unsigned mPredBegin;
+		unsigned mNextPred;
+		unsigned mPredEnd;
+	};
+
+	// The stack of frames for the read in progress
+	std::vector<Frame> mFrames;
+	std::vector<llvm::BasicBlock*> mPreds;
+
+	// Incremented for each walk up the predecessors, to mark the blocks it visited
+	unsigned mEpoch;
+
+	// All the data for the current function is allocated from this,
+	// so reset() releases it all at once
+	llvm::BumpPtrAllocator mArena;
+
+	// Blocks and variables are numbered densely, in the order they're seen
+	Table<unsigned> mBlockIds;
+	Table<unsigned> mVarIds;
+
+	// This stores the blocks (indexed by their number)
+	Array<BlockInfo> mBlocks;
+
+	// Bit set of the sealed blocks in the current function
+	Array<uint64_t> mSealed;
+
+	// This stores the variable definitions, keyed by (block, variable)
+	Table<llvm::Value*> mDefs;
+
+	// The reverse of mDefs for phis, so a trivial phi can be replaced
+	// without searching all the definitions
+	Table<DefSlot*> mPhiDefs;
+
+	// The last block that was looked up
+	// (reads and writes tend to happen in the same block)
+	llvm::BasicBlock* mLastBlock;
+	unsigned mLastBlockId;
 };
-	
+
 } // opt
 } // uscc
@@ -0,0 +1,229 @@
+//
+//  SimplifyCFG.cpp
+//  uscc
+//
+//  Implements the CFG Simplification opt pass.
+//  This merges straight-line chains of blocks, forwards
+//  branches through empty blocks, and folds the phis that
+//  are left with only one value, until nothing changes.
+//
+//---------------------------------------------------------
+//  Copyright (c) 2014, Sanjay Madhav
+//  All rights reserved.
+//
+//  This file is distributed under the BSD license.
+//  See LICENSE.TXT for details.
+//---------------------------------------------------------
+#include "Passes.h"
+#include "../parse/TimeTrace.h"
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wconversion"
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/CFG.h>
+#include <llvm/ADT/DepthFirstIterator.h>
+#pragma clang diagnostic pop
+#include <vector>
+
+using namespace llvm;
+
+namespace uscc
+{
+namespace opt
+{
+
+bool SimplifyCFG::runOnFunction(Function& F)
+{
+	parse::TimeScope timer("SimplifyCFG", F.getName());
+
+	bool changed = false;
+	bool iterChanged = true;
+	while (iterChanged)
+	{
+		iterChanged = removeUnreachableBlocks(F);
+		iterChanged |= foldPhis(F);
+
+		// (The entry block can't be merged away or forwarded,
+		// since it has no predecessors)
+		Function::iterator blockIter = F.begin();
+		++blockIter;
+		while (blockIter != F.end())
+		{
+			BasicBlock* block = blockIter;
+			++blockIter;
+
+			if (mergeIntoPredecessor(block) || forwardEmptyBlock(block))
+			{
+				iterChanged = true;
+			}
+		}
+
+		changed |= iterChanged;
+	}
+
+	return changed;
+}
+
+void SimplifyCFG::getAnalysisUsage(AnalysisUsage& Info) const
+{
+	// This changes the CFG, so nothing is preserved
+}
+
+// Erases the blocks that can't be reached from the entry block
+bool SimplifyCFG::removeUnreachableBlocks(Function& F)
+{
+	SmallPtrSet<BasicBlock*, 32> reachable;
+	for (df_iterator<BasicBlock*> iter = df_begin(&F.getEntryBlock());
+		 iter != df_end(&F.getEntryBlock()); ++iter)
+	{
+		reachable.insert(*iter);
+	}
+
+	std::vector<BasicBlock*> dead;
+	for (BasicBlock& block : F)
+	{
+		if (reachable.count(&block) == 0)
+		{
+			dead.push_back(&block);
+		}
+	}
+
+	// The dead blocks may use each other's values, so all their
+	// references are dropped before any of them are erased
+	for (BasicBlock* block : dead)
+	{
+		for (succ_iterator succ = succ_begin(block); succ != succ_end(block); ++succ)
+		{
+			succ->removePredecessor(block);
+		}
+		block->dropAllReferences();
+	}
+
+	for (BasicBlock* block : dead)
+	{
+		block->eraseFromParent();
+	}
+
+	return !dead.empty();
+}
+
+// Replaces the phis that only merge one value with that value
+bool SimplifyCFG::foldPhis(Function& F)
+{
+	bool changed = false;
+	for (BasicBlock& block : F)
+	{
+		BasicBlock::iterator instrIter = block.begin();
+		while (PHINode* phi = dyn_cast<PHINode>(instrIter))
+		{
+			++instrIter;
+
+			Value* same = phi->hasConstantValue();
+			if (same != nullptr)
+			{
+				phi->replaceAllUsesWith(same);
+				phi->eraseFromParent();
+				changed = true;
+			}
+		}
+	}
+
+	return changed;
+}
+
+// If the block's only predecessor only branches to it,
+// moves the block's instructions to the end of the predecessor
+bool SimplifyCFG::mergeIntoPredecessor(BasicBlock* block)
+{
+	BasicBlock* pred = block->getSinglePredecessor();
+	if (pred == nullptr || pred == block || pred->getTerminator()->getNumSuccessors() != 1)
+	{
+		return false;
+	}
+
+	// With one predecessor, each phi has one value
+	while (PHINode* phi = dyn_cast<PHINode>(block->begin()))
+	{
+		phi->replaceAllUsesWith(phi->getIncomingValue(0));
+		phi->eraseFromParent();
+	}
+
+	pred->getTerminator()->eraseFromParent();
+	pred->getInstList().splice(pred->end(), block->getInstList());
+
+	// The successors' phis now have values coming from the predecessor
+	block->replaceAllUsesWith(pred);
+	block->eraseFromParent();
+	return true;
+}
+
+// If the block only branches to another block, changes its
+// predecessors to branch to that block instead
+bool SimplifyCFG::forwardEmptyBlock(BasicBlock* block)
+{
+	BranchInst* branch = dyn_cast<BranchInst>(block->begin());
+	if (branch == nullptr || branch->isConditional())
+	{
+		return false;
+	}
+
+	BasicBlock* succ = branch->getSuccessor(0);
+	if (succ == block || pred_begin(block) == pred_end(block))
+	{
+		return false;
+	}
+
+	// If a predecessor already branches to the successor, its phis
+	// could need two different values for the same edge
+	bool hasPhis = isa<PHINode>(succ->begin());
+	if (hasPhis)
+	{
+		for (pred_iterator pred = pred_begin(block); pred != pred_end(block); ++pred)
+		{
+			for (pred_iterator succPred = pred_begin(succ); succPred != pred_end(succ); ++succPred)
+			{
+				if (*pred == *succPred)
+				{
+					return false;
+				}
+			}
+		}
+	}
+
+	// The values the phis had coming from this block now come from
+	// each of its predecessors (once for each edge)
+	std::vector<BasicBlock*> preds(pred_begin(block), pred_end(block));
+	for (BasicBlock::iterator iter = succ->begin(); isa<PHINode>(iter); ++iter)
+	{
+		PHINode* phi = cast<PHINode>(iter);
+		Value* value = phi->removeIncomingValue(block, false);
+		for (BasicBlock* pred : preds)
+		{
+			phi->addIncoming(value, pred);
+		}
+	}
+
+	block->replaceAllUsesWith(succ);
+	block->eraseFromParent();
+
+	// A conditional branch that now goes to the same place either way
+	// doesn't need its condition (or the phi values for its second edge)
+	for (BasicBlock* pred : preds)
+	{
+		BranchInst* predBranch = dyn_cast<BranchInst>(pred->getTerminator());
+		if (predBranch != nullptr && predBranch->isConditional() &&
+			predBranch->getSuccessor(0) == predBranch->getSuccessor(1))
+		{
+			succ->removePredecessor(pred, true);
+			BranchInst::Create(succ, pred);
+			predBranch->eraseFromParent();
+		}
+	}
+
+	return true;
+}
+
+} // opt
+} // uscc
+
+char uscc::opt::SimplifyCFG::ID = 0;
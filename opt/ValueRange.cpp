@@ -0,0 +1,565 @@
+//
+//  ValueRange.cpp
+//  uscc
+//
+//  Implements the Value Range analysis.
+//  This computes an interval of the signed values each
+//  integer can have. The conditions of branches narrow the
+//  ranges in the blocks they dominate, and loops are solved
+//  by iterating (widening ranges that keep growing).
+//
+//---------------------------------------------------------
+//  Copyright (c) 2014, Sanjay Madhav
+//  All rights reserved.
+//
+//  This file is distributed under the BSD license.
+//  See LICENSE.TXT for details.
+//---------------------------------------------------------
+#include "Passes.h"
+#include "../parse/TimeTrace.h"
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wconversion"
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/ADT/PostOrderIterator.h>
+#include <llvm/Support/raw_ostream.h>
+#pragma clang diagnostic pop
+#include <algorithm>
+#include <mutex>
+#include <string>
+
+using namespace llvm;
+
+namespace
+{
+	// A range that changes more times than this is widened to
+	// the limits of its type, so loops don't iterate for every value
+	const unsigned WidenAfter = 3;
+
+	// The ranges of each function are printed at once, so the
+	// functions on different threads don't interleave
+	std::mutex printMutex;
+}
+
+namespace uscc
+{
+namespace opt
+{
+
+bool ValueRange::runOnFunction(Function& F)
+{
+	parse::TimeScope timer("ValueRange", F.getName());
+
+	mDomTree = &getAnalysis<DominatorTreeWrapperPass>().getDomTree();
+	mRanges.clear();
+
+	// Every range starts out empty, and only grows
+	DenseMap<Instruction*, unsigned> updates;
+	ReversePostOrderTraversal<Function*> rpo(&F);
+	bool changed = true;
+	while (changed)
+	{
+		changed = false;
+		for (BasicBlock* block : rpo)
+		{
+			for (Instruction& instr : *block)
+			{
+				if (!instr.getType()->isIntegerTy())
+				{
+					continue;
+				}
+
+				Range oldRange = getRange(&instr);
+				Range newRange = getUnion(oldRange, evaluate(&instr));
+				if (newRange.mLo == oldRange.mLo && newRange.mHi == oldRange.mHi)
+				{
+					continue;
+				}
+
+				if (++updates[&instr] > WidenAfter && !oldRange.isEmpty())
+				{
+					Range full = getFullRange(instr.getType());
+					if (newRange.mLo < oldRange.mLo)
+					{
+						newRange.mLo = full.mLo;
+					}
+					if (newRange.mHi > oldRange.mHi)
+					{
+						newRange.mHi = full.mHi;
+					}
+				}
+
+				mRanges[&instr] = newRange;
+				changed = true;
+			}
+		}
+	}
+
+	if (mPrint)
+	{
+		printRanges(F);
+	}
+
+	// This is only an analysis
+	return false;
+}
+
+void ValueRange::getAnalysisUsage(AnalysisUsage& Info) const
+{
+	Info.setPreservesAll();
+	Info.addRequired<DominatorTreeWrapperPass>();
+}
+
+// Returns the range of the value where it's defined
+// (An instruction that can't execute has an empty range)
+ValueRange::Range ValueRange::getRange(Value* value) const
+{
+	if (ConstantInt* constant = dyn_cast<ConstantInt>(value))
+	{
+		// (i1 is treated as unsigned, so true is 1)
+		int64_t v = constant->getType()->isIntegerTy(1) ?
+			static_cast<int64_t>(constant->getZExtValue()) : constant->getSExtValue();
+		return Range(v, v);
+	}
+	else if (Instruction* instr = dyn_cast<Instruction>(value))
+	{
+		auto iter = mRanges.find(instr);
+		return (iter != mRanges.end()) ? iter->second : Range();
+	}
+
+	// Arguments and undef could be anything
+	return getFullRange(value->getType());
+}
+
+// Returns the range of the value in the block, which is narrowed by
+// the conditions of the branches that lead to the block
+ValueRange::Range ValueRange::getRangeAt(Value* value, BasicBlock* block) const
+{
+	Range range = getRange(value);
+
+	// Constants can't be narrowed (and they have users all over the module)
+	if ((!isa<Instruction>(value) && !isa<Argument>(value)) ||
+		mDomTree->getNode(block) == nullptr)
+	{
+		return range;
+	}
+
+	// Only the edges out of a branch on a compare of the value narrow it,
+	// so those are found from its uses (rather than by walking up all the
+	// dominators of the block). The edge into a block with one predecessor
+	// is always taken to reach the blocks it dominates.
+	for (User* user : value->users())
+	{
+		ICmpInst* cmp = dyn_cast<ICmpInst>(user);
+		if (cmp == nullptr)
+		{
+			continue;
+		}
+
+		for (User* cmpUser : cmp->users())
+		{
+			BranchInst* branch = dyn_cast<BranchInst>(cmpUser);
+			if (branch == nullptr || branch->getCondition() != cmp)
+			{
+				continue;
+			}
+
+			BasicBlock* from = branch->getParent();
+			for (unsigned i = 0; i < branch->getNumSuccessors() && !range.isEmpty(); i++)
+			{
+				BasicBlock* to = branch->getSuccessor(i);
+				if (to->getSinglePredecessor() == from && mDomTree->dominates(to, block))
+				{
+					range = getIntersection(range, getConstraint(value, from, to));
+				}
+			}
+		}
+	}
+
+	return range;
+}
+
+// Returns the range of the value when it flows along the edge
+ValueRange::Range ValueRange::getRangeOnEdge(Value* value, BasicBlock* from, BasicBlock* to) const
+{
+	return getIntersection(getRangeAt(value, from), getConstraint(value, from, to));
+}
+
+// Returns the limits of the integer type (i1 is [0, 1])
+ValueRange::Range ValueRange::getFullRange(Type* type)
+{
+	unsigned bits = type->getIntegerBitWidth();
+	if (bits == 1)
+	{
+		return Range(0, 1);
+	}
+	else if (bits >= 64)
+	{
+		return Range(INT64_MIN, INT64_MAX);
+	}
+
+	return Range(-(INT64_C(1) << (bits - 1)), (INT64_C(1) << (bits - 1)) - 1);
+}
+
+ValueRange::Range ValueRange::getUnion(const Range& a, const Range& b)
+{
+	if (a.isEmpty())
+	{
+		return b;
+	}
+	else if (b.isEmpty())
+	{
+		return a;
+	}
+
+	return Range(std::min(a.mLo, b.mLo), std::max(a.mHi, b.mHi));
+}
+
+ValueRange::Range ValueRange::getIntersection(const Range& a, const Range& b)
+{
+	return Range(std::max(a.mLo, b.mLo), std::min(a.mHi, b.mHi));
+}
+
+// Returns the range if it fits in the type, or the full range if
+// it doesn't (since the result wraps around)
+ValueRange::Range ValueRange::getWrapped(const Range& range, Type* type)
+{
+	Range full = getFullRange(type);
+	if (range.mLo < full.mLo || range.mHi > full.mHi)
+	{
+		return full;
+	}
+
+	return range;
+}
+
+// Returns 1 if the compare is true for all the values in the ranges,
+// 0 if it's false for all of them, and -1 if it depends
+int ValueRange::getCompareResult(CmpInst::Predicate pred, const Range& a, const Range& b)
+{
+	if (a.isEmpty() || b.isEmpty())
+	{
+		return -1;
+	}
+
+	// Unsigned compares are the same as signed ones for values that
+	// aren't negative
+	if (CmpInst::isUnsigned(pred))
+	{
+		if (a.mLo < 0 || b.mLo < 0)
+		{
+			return -1;
+		}
+		pred = CmpInst::getSignedPredicate(pred);
+	}
+
+	switch (pred)
+	{
+		case CmpInst::ICMP_EQ:
+			if (a.isSingle() && b.isSingle() && a.mLo == b.mLo)
+			{
+				return 1;
+			}
+			return getIntersection(a, b).isEmpty() ? 0 : -1;
+		case CmpInst::ICMP_NE:
+		{
+			int result = getCompareResult(CmpInst::ICMP_EQ, a, b);
+			return (result == -1) ? -1 : 1 - result;
+		}
+		case CmpInst::ICMP_SLT:
+			return (a.mHi < b.mLo) ? 1 : (a.mLo >= b.mHi) ? 0 : -1;
+		case CmpInst::ICMP_SLE:
+			return (a.mHi <= b.mLo) ? 1 : (a.mLo > b.mHi) ? 0 : -1;
+		case CmpInst::ICMP_SGT:
+			return getCompareResult(CmpInst::ICMP_SLT, b, a);
+		case CmpInst::ICMP_SGE:
+			return getCompareResult(CmpInst::ICMP_SLE, b, a);
+		default:
+			return -1;
+	}
+}
+
+// Returns the range of the result of the instruction, from
+// the current ranges of its operands
+ValueRange::Range ValueRange::evaluate(Instruction* instr) const
+{
+	Type* type = instr->getType();
+	Range full = getFullRange(type);
+
+	if (PHINode* phi = dyn_cast<PHINode>(instr))
+	{
+		Range range;
+		for (unsigned i = 0; i < phi->getNumIncomingValues(); i++)
+		{
+			range = getUnion(range, getRangeOnEdge(phi->getIncomingValue(i),
+												   phi->getIncomingBlock(i),
+												   phi->getParent()));
+		}
+		return range;
+	}
+	else if (ICmpInst* cmp = dyn_cast<ICmpInst>(instr))
+	{
+		BasicBlock* block = cmp->getParent();
+		Range lhs = getRangeAt(cmp->getOperand(0), block);
+		Range rhs = getRangeAt(cmp->getOperand(1), block);
+		if (lhs.isEmpty() || rhs.isEmpty())
+		{
+			return Range();
+		}
+
+		int result = getCompareResult(cmp->getPredicate(), lhs, rhs);
+		return (result == -1) ? full : Range(result, result);
+	}
+	else if (SelectInst* select = dyn_cast<SelectInst>(instr))
+	{
+		Range cond = getRange(select->getCondition());
+		if (cond.isEmpty())
+		{
+			return Range();
+		}
+
+		Range range;
+		if (cond.mHi == 1)
+		{
+			range = getUnion(range, getRange(select->getTrueValue()));
+		}
+		if (cond.mLo == 0)
+		{
+			range = getUnion(range, getRange(select->getFalseValue()));
+		}
+		return range;
+	}
+	else if (CastInst* castInst = dyn_cast<CastInst>(instr))
+	{
+		Value* src = castInst->getOperand(0);
+		if (!src->getType()->isIntegerTy())
+		{
+			return full;
+		}
+
+		Range range = getRange(src);
+		if (range.isEmpty())
+		{
+			return range;
+		}
+
+		switch (castInst->getOpcode())
+		{
+			case Instruction::SExt:
+				// (An i1 is either 0 or 1, which sign extend to 0 or -1)
+				return src->getType()->isIntegerTy(1) ? Range(-range.mHi, -range.mLo) : range;
+			case Instruction::ZExt:
+				return (range.mLo >= 0) ? range :
+					Range(0, (INT64_C(1) << src->getType()->getIntegerBitWidth()) - 1);
+			case Instruction::Trunc:
+				return getWrapped(range, type);
+			default:
+				return full;
+		}
+	}
+
+	BinaryOperator* binOp = dyn_cast<BinaryOperator>(instr);
+	if (binOp == nullptr || type->getIntegerBitWidth() > 32)
+	{
+		// Loads, calls and everything else could be anything
+		// (and 64-bit math could overflow the bounds)
+		return full;
+	}
+
+	BasicBlock* block = binOp->getParent();
+	Range lhs = getRangeAt(binOp->getOperand(0), block);
+	Range rhs = getRangeAt(binOp->getOperand(1), block);
+	if (lhs.isEmpty() || rhs.isEmpty())
+	{
+		return Range();
+	}
+
+	Range exact = getExactRange(binOp->getOpcode(), lhs, rhs);
+	return exact.isEmpty() ? full : getWrapped(exact, type);
+}
+
+// Returns the range of the (mathematically exact) result of the 32-bit
+// or smaller operation, or an empty range if it's not known
+ValueRange::Range ValueRange::getExactRange(unsigned opcode, const Range& lhs, const Range& rhs)
+{
+	switch (opcode)
+	{
+		case Instruction::Add:
+			return Range(lhs.mLo + rhs.mLo, lhs.mHi + rhs.mHi);
+		case Instruction::Sub:
+			return Range(lhs.mLo - rhs.mHi, lhs.mHi - rhs.mLo);
+		case Instruction::Mul:
+		{
+			int64_t corners[] = { lhs.mLo * rhs.mLo, lhs.mLo * rhs.mHi,
+				lhs.mHi * rhs.mLo, lhs.mHi * rhs.mHi };
+			return Range(*std::min_element(corners, corners + 4),
+						 *std::max_element(corners, corners + 4));
+		}
+		case Instruction::SDiv:
+		{
+			if (rhs.isSingle() && rhs.mLo > 0)
+			{
+				return Range(lhs.mLo / rhs.mLo, lhs.mHi / rhs.mLo);
+			}
+
+			// Otherwise, the result is no bigger than the dividend
+			int64_t bound = std::max(-lhs.mLo, lhs.mHi);
+			return Range(-bound, bound);
+		}
+		case Instruction::SRem:
+		{
+			// The remainder is smaller than the divisor, and
+			// has the same sign as the dividend
+			int64_t bound = std::max(-rhs.mLo, rhs.mHi) - 1;
+			if (bound < 0)
+			{
+				return Range();
+			}
+			return Range(std::max(std::min(lhs.mLo, INT64_C(0)), -bound),
+						 std::min(std::max(lhs.mHi, INT64_C(0)), bound));
+		}
+		case Instruction::And:
+			// Masking with a value that isn't negative can't make it bigger
+			if (rhs.mLo >= 0)
+			{
+				return Range(0, (lhs.mLo >= 0) ? std::min(lhs.mHi, rhs.mHi) : rhs.mHi);
+			}
+			break;
+		case Instruction::AShr:
+			if (rhs.isSingle() && rhs.mLo >= 0 && rhs.mLo < 32)
+			{
+				return Range(lhs.mLo >> rhs.mLo, lhs.mHi >> rhs.mLo);
+			}
+			break;
+		case Instruction::LShr:
+			if (rhs.isSingle() && rhs.mLo >= 0 && rhs.mLo < 32 && lhs.mLo >= 0)
+			{
+				return Range(lhs.mLo >> rhs.mLo, lhs.mHi >> rhs.mLo);
+			}
+			break;
+		case Instruction::Shl:
+			if (rhs.isSingle() && rhs.mLo >= 0 && rhs.mLo < 32)
+			{
+				return getExactRange(Instruction::Mul, lhs, Range(INT64_C(1) << rhs.mLo,
+																  INT64_C(1) << rhs.mLo));
+			}
+			break;
+		default:
+			break;
+	}
+
+	return Range();
+}
+
+// Returns the range the value must be in if the edge is taken
+// (because of the condition of the branch)
+ValueRange::Range ValueRange::getConstraint(Value* value, BasicBlock* from, BasicBlock* to) const
+{
+	Range full = getFullRange(value->getType());
+
+	// (The bounds of 64-bit values could overflow)
+	BranchInst* branch = dyn_cast<BranchInst>(from->getTerminator());
+	if (value->getType()->getIntegerBitWidth() > 32 ||
+		branch == nullptr || branch->isUnconditional() ||
+		branch->getSuccessor(0) == branch->getSuccessor(1))
+	{
+		return full;
+	}
+
+	ICmpInst* cmp = dyn_cast<ICmpInst>(branch->getCondition());
+	if (cmp == nullptr)
+	{
+		return full;
+	}
+
+	// Put the value on the left of the compare, and use the
+	// predicate that's true on this edge
+	CmpInst::Predicate pred = cmp->getPredicate();
+	Value* other = nullptr;
+	if (cmp->getOperand(0) == value)
+	{
+		other = cmp->getOperand(1);
+	}
+	else if (cmp->getOperand(1) == value)
+	{
+		other = cmp->getOperand(0);
+		pred = CmpInst::getSwappedPredicate(pred);
+	}
+	else
+	{
+		return full;
+	}
+
+	if (branch->getSuccessor(1) == to)
+	{
+		pred = CmpInst::getInversePredicate(pred);
+	}
+
+	Range bound = getRange(other);
+	if (bound.isEmpty())
+	{
+		return full;
+	}
+
+	switch (pred)
+	{
+		case CmpInst::ICMP_EQ:
+			return bound;
+		case CmpInst::ICMP_SLT:
+			return Range(full.mLo, bound.mHi - 1);
+		case CmpInst::ICMP_SLE:
+			return Range(full.mLo, bound.mHi);
+		case CmpInst::ICMP_SGT:
+			return Range(bound.mLo + 1, full.mHi);
+		case CmpInst::ICMP_SGE:
+			return Range(bound.mLo, full.mHi);
+		case CmpInst::ICMP_ULT:
+			// (A value that's unsigned less than one that isn't negative
+			// isn't negative either)
+			return (bound.mLo >= 0) ? Range(0, bound.mHi - 1) : full;
+		case CmpInst::ICMP_ULE:
+			return (bound.mLo >= 0) ? Range(0, bound.mHi) : full;
+		default:
+			return full;
+	}
+}
+
+// Prints the range of each integer instruction to stderr
+void ValueRange::printRanges(Function& F) const
+{
+	std::string output;
+	raw_string_ostream stream(output);
+	stream << "Value ranges for " << F.getName() << ":\n";
+	for (BasicBlock& block : F)
+	{
+		for (Instruction& instr : block)
+		{
+			if (!instr.getType()->isIntegerTy())
+			{
+				continue;
+			}
+
+			stream << "  ";
+			instr.printAsOperand(stream, false);
+			Range range = getRange(&instr);
+			if (range.isEmpty())
+			{
+				stream << " = unreachable\n";
+			}
+			else
+			{
+				stream << " = [" << range.mLo << ", " << range.mHi << "]\n";
+			}
+		}
+	}
+	stream.flush();
+
+	std::lock_guard<std::mutex> lock(printMutex);
+	errs() << output;
+}
+
+} // opt
+} // uscc
+
+char uscc::opt::ValueRange::ID = 0;
@@ -14,6 +14,7 @@
 
 #include "ASTNodes.h"
 #include "Emitter.h"
+#include "TimeTrace.h"
 
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wconversion"
@@ -38,6 +39,22 @@ using namespace llvm;
 
 // Program/Functions
 AST_EMIT(ASTProgram)
+{
+	TimeScope timer("EmitProgram");
+	
+	emitGlobals(ctx);
+	
+	// Emit code for all the functions
+	emitFunctions(ctx, 0, mFuncs.size());
+	
+	// A program actually doesn't have a value to return, since everything
+	// is stored in Module
+	return nullptr;
+}
+
+// Creates the module, and emits the string table and
+// the declaration for printf (if it's needed)
+void ASTProgram::emitGlobals(CodeContext& ctx) noexcept
 {
 	ctx.mModule = new Module("main", ctx.mGlobal);
 	
@@ -56,23 +73,29 @@ AST_EMIT(ASTProgram)
 		Function* func = Function::Create(printfType, GlobalValue::LinkageTypes::ExternalLinkage,
 										  "printf", ctx.mModule);
 		func->setCallingConv(CallingConv::C);
-		
-		// Map the printf ident to this function
-		ctx.mPrintfIdent->setAddress(func);
 	}
-	
-	// Emit code for all the functions
-	for (auto f : mFuncs)
+}
+
+// Emits the functions in the range [begin, end)
+void ASTProgram::emitFunctions(CodeContext& ctx, size_t begin, size_t end) noexcept
+{
+	for (size_t i = begin; i < end; i++)
 	{
-		f->emitIR(ctx);
+		mFuncs[i]->emitIR(ctx);
 	}
-	// A program actually doesn't have a value to return, since everything
-	// is stored in Module
-	return nullptr;
 }
 
-AST_EMIT(ASTFunction)
+// Returns this function in the current module, and declares
+// it if it isn't there yet (which is the case when it's
+// called from a different shard of the program)
+llvm::Function* ASTFunction::emitDeclaration(CodeContext& ctx) noexcept
 {
+	Function* func = ctx.mModule->getFunction(mIdent.getName());
+	if (func != nullptr)
+	{
+		return func;
+	}
+	
 	FunctionType* funcType = nullptr;
 	
 	// First get the return type (there's only three choices)
@@ -100,23 +123,30 @@ AST_EMIT(ASTFunction)
 		std::vector<llvm::Type*> args;
 		for (auto arg : mArgs)
 		{
-			args.push_back(arg->getIdent().llvmType());
+			args.push_back(arg->getIdent().llvmType(ctx.mGlobal));
 		}
 		
 		funcType = FunctionType::get(retType, args, false);
 	}
 	
+	func = Function::Create(funcType,
+							GlobalValue::LinkageTypes::ExternalLinkage,
+							mIdent.getName(), ctx.mModule);
+	func->setCallingConv(CallingConv::C);
+	
+	return func;
+}
+
+AST_EMIT(ASTFunction)
+{
+	TimeScope timer("EmitFunction", mIdent.getName());
+	
 	// Create the function, and make it the current one
-	ctx.mFunc = Function::Create(funcType,
-								 GlobalValue::LinkageTypes::ExternalLinkage,
-								 mIdent.getName(), ctx.mModule);
+	ctx.mFunc = emitDeclaration(ctx);
 	
 	// Now that we have a new function, reset our SSA builder
 	ctx.mSSA.reset();
 	
-	// Map the ident to this function
-	mIdent.setAddress(ctx.mFunc);
-	
 	// Create the entry basic block
 	ctx.mBlock = BasicBlock::Create(ctx.mGlobal, "entry", ctx.mFunc);
 	// Add and seal this block
@@ -149,14 +179,15 @@ AST_EMIT(ASTFunction)
 		}
 	}
 	
-	ctx.mFunc->setCallingConv(CallingConv::C);
-	
 	// Add all the declarations for variables created in this function
 	mScopeTable.emitIR(ctx);
 	
 	// Now emit the body
 	mBody->emitIR(ctx);
 	
+	// Clean up the phis that only pass a value around in a loop
+	ctx.mSSA.removeRedundantPhis(ctx.mFunc);
+	
 	return ctx.mFunc;
 }
 
@@ -181,6 +212,15 @@ AST_EMIT(ASTArraySub)
 
 // Expressions
 
+// Emits the expression as a condition, which is an i1 that's true
+// if the value is nonzero
+Value* ASTExpr::emitCondition(CodeContext& ctx) noexcept
+{
+	Value* value = emitIR(ctx);
+	IRBuilder<> build(ctx.mBlock);
+	return build.CreateICmpNE(value, Constant::getNullValue(value->getType()), "tobool");
+}
+
 AST_EMIT(ASTBadExpr)
 {
 	// This node will never be emitted
@@ -188,9 +228,29 @@ AST_EMIT(ASTBadExpr)
 }
 
 AST_EMIT(ASTLogicalAnd)
+{
+	Value* cond = emitCondition(ctx);
+	IRBuilder<> build(ctx.mBlock);
+	return build.CreateZExt(cond, llvm::Type::getInt32Ty(ctx.mGlobal));
+}
+
+// Emits the expression as a condition, which is an i1 that's true
+// if the value is nonzero
+Value* ASTLogicalAnd::emitCondition(CodeContext& ctx) noexcept
 {
 	// This is extremely similar to logical or
 	
+	// If the rhs has no side effects (and can't trap), it's cheaper to
+	// evaluate both sides than to branch around the rhs
+	if (mRHS->isSpeculatable())
+	{
+		Value* lhsVal = mLHS->emitCondition(ctx);
+		Value* rhsVal = mRHS->emitCondition(ctx);
+		
+		IRBuilder<> build(ctx.mBlock);
+		return build.CreateAnd(lhsVal, rhsVal);
+	}
+	
 	// Create the block for the RHS
 	BasicBlock* rhsBlock = BasicBlock::Create(ctx.mGlobal, "and.rhs", ctx.mFunc);
 	// Add the rhs block to SSA (not sealed)
@@ -204,16 +264,13 @@ AST_EMIT(ASTLogicalAnd)
 	ctx.mSSA.addBlock(endBlock);
 	
 	// Now generate the LHS
-	Value* lhsVal = mLHS->emitIR(ctx);
+	Value* lhsVal = mLHS->emitCondition(ctx);
 	
 	BasicBlock* lhsBlock = ctx.mBlock;
 	
 	// Add the branch to the end of the LHS
 	{
 		IRBuilder<> build(ctx.mBlock);
-		// We can assume it WILL be an i32 here
-		// since it'd have been zero-extended otherwise
-		lhsVal = build.CreateICmpNE(lhsVal, ctx.mZero, "tobool");
 		build.CreateCondBr(lhsVal, rhsBlock, endBlock);
 	}
 	
@@ -222,7 +279,7 @@ AST_EMIT(ASTLogicalAnd)
 	
 	// Code should now be generated in the RHS block
 	ctx.mBlock = rhsBlock;
-	Value* rhsVal = mRHS->emitIR(ctx);
+	Value* rhsVal = mRHS->emitCondition(ctx);
 	
 	// This is the final RHS block (for the phi node)
 	rhsBlock = ctx.mBlock;
@@ -230,7 +287,6 @@ AST_EMIT(ASTLogicalAnd)
 	// Add the branch and the end of the RHS
 	{
 		IRBuilder<> build(ctx.mBlock);
-		rhsVal = build.CreateICmpNE(rhsVal, ctx.mZero, "tobool");
 		
 		// We do an unconditional branch because the phi mode will handle
 		// the correct value
@@ -244,8 +300,8 @@ AST_EMIT(ASTLogicalAnd)
 	
 	IRBuilder<> build(ctx.mBlock);
 	
-	// Figure out the value to zext
-	Value* zextVal = nullptr;
+	// Figure out the value of the condition
+	Value* condVal = nullptr;
 	
 	// If rhs is not also false, we need to make a phi
 	if (rhsVal != ConstantInt::getFalse(ctx.mGlobal))
@@ -254,18 +310,38 @@ AST_EMIT(ASTLogicalAnd)
 		// If we came from the lhs, it had to be false
 		phi->addIncoming(ConstantInt::getFalse(ctx.mGlobal), lhsBlock);
 		phi->addIncoming(rhsVal, rhsBlock);
-		zextVal = phi;
+		condVal = phi;
 	}
 	else
 	{
-		zextVal = ConstantInt::getFalse(ctx.mGlobal);
+		condVal = ConstantInt::getFalse(ctx.mGlobal);
 	}
 	
-	return build.CreateZExt(zextVal, llvm::Type::getInt32Ty(ctx.mGlobal));
+	return condVal;
 }
 
 AST_EMIT(ASTLogicalOr)
 {
+	Value* cond = emitCondition(ctx);
+	IRBuilder<> build(ctx.mBlock);
+	return build.CreateZExt(cond, llvm::Type::getInt32Ty(ctx.mGlobal));
+}
+
+// Emits the expression as a condition, which is an i1 that's true
+// if the value is nonzero
+Value* ASTLogicalOr::emitCondition(CodeContext& ctx) noexcept
+{
+	// If the rhs has no side effects (and can't trap), it's cheaper to
+	// evaluate both sides than to branch around the rhs
+	if (mRHS->isSpeculatable())
+	{
+		Value* lhsVal = mLHS->emitCondition(ctx);
+		Value* rhsVal = mRHS->emitCondition(ctx);
+		
+		IRBuilder<> build(ctx.mBlock);
+		return build.CreateOr(lhsVal, rhsVal);
+	}
+	
 	// Create the block for the RHS
 	BasicBlock* rhsBlock = BasicBlock::Create(ctx.mGlobal, "lor.rhs", ctx.mFunc);
 	// Add the rhs block to SSA (not sealed)
@@ -279,16 +355,13 @@ AST_EMIT(ASTLogicalOr)
 	ctx.mSSA.addBlock(endBlock);
 	
 	// Now generate the LHS
-	Value* lhsVal = mLHS->emitIR(ctx);
+	Value* lhsVal = mLHS->emitCondition(ctx);
 	
 	BasicBlock* lhsBlock = ctx.mBlock;
 	
 	// Add the branch to the end of the LHS
 	{
 		IRBuilder<> build(ctx.mBlock);
-		// We can assume it WILL be an i32 here
-		// since it'd have been zero-extended otherwise
-		lhsVal = build.CreateICmpNE(lhsVal, ctx.mZero, "tobool");
 		build.CreateCondBr(lhsVal, endBlock, rhsBlock);
 	}
 	
@@ -297,7 +370,7 @@ AST_EMIT(ASTLogicalOr)
 	
 	// Code should now be generated in the RHS block
 	ctx.mBlock = rhsBlock;
-	Value* rhsVal = mRHS->emitIR(ctx);
+	Value* rhsVal = mRHS->emitCondition(ctx);
 	
 	// This is the final RHS block (for the phi node)
 	rhsBlock = ctx.mBlock;
@@ -305,7 +378,6 @@ AST_EMIT(ASTLogicalOr)
 	// Add the branch and the end of the RHS
 	{
 		IRBuilder<> build(ctx.mBlock);
-		rhsVal = build.CreateICmpNE(rhsVal, ctx.mZero, "tobool");
 		
 		// We do an unconditional branch because the phi mode will handle
 		// the correct value
@@ -319,8 +391,8 @@ AST_EMIT(ASTLogicalOr)
 	
 	IRBuilder<> build(ctx.mBlock);
 	
-	// Figure out the value to zext
-	Value* zextVal = nullptr;
+	// Figure out the value of the condition
+	Value* condVal = nullptr;
 	
 	// If rhs is not also true, we need to make a phi
 	if (rhsVal != ConstantInt::getTrue(ctx.mGlobal))
@@ -329,14 +401,14 @@ AST_EMIT(ASTLogicalOr)
 		// If we came from the lhs, it had to be false
 		phi->addIncoming(ConstantInt::getTrue(ctx.mGlobal), lhsBlock);
 		phi->addIncoming(rhsVal, rhsBlock);
-		zextVal = phi;
+		condVal = phi;
 	}
 	else
 	{
-		zextVal = ConstantInt::getTrue(ctx.mGlobal);
+		condVal = ConstantInt::getTrue(ctx.mGlobal);
 	}
 	
-	return build.CreateZExt(zextVal, llvm::Type::getInt32Ty(ctx.mGlobal));
+	return condVal;
 }
 
 AST_EMIT(ASTBinaryCmpOp)
@@ -345,13 +417,29 @@ AST_EMIT(ASTBinaryCmpOp)
 	
     // PA3: Implement
     
-    // build IR
-    IRBuilder<> build(ctx.mBlock);
+    // (The comparison is an i1, which is widened to an int)
+    retVal = emitCondition(ctx);
     
+    IRBuilder<> build(ctx.mBlock);
+    retVal = build.CreateZExt(retVal, llvm::Type::getInt32Ty(ctx.mGlobal));
+	
+	return retVal;
+}
+
+// Emits the expression as a condition, which is an i1 that's true
+// if the value is nonzero
+Value* ASTBinaryCmpOp::emitCondition(CodeContext& ctx) noexcept
+{
+	Value* retVal = nullptr;
+	
     // build expressions for lhs and rhs
+    // (before the builder, since they can add blocks)
     Value* lhs = mLHS->emitIR(ctx);
     Value* rhs = mRHS->emitIR(ctx);
     
+    // build IR
+    IRBuilder<> build(ctx.mBlock);
+    
     // build instruction
     if (mOp == scan::Token::Tokens::GreaterThan) {
         retVal = build.CreateICmpSGT(lhs, rhs);
@@ -365,8 +453,6 @@ AST_EMIT(ASTBinaryCmpOp)
     else if (mOp == scan::Token::Tokens::LessThan) {
         retVal = build.CreateICmpSLT(lhs, rhs);
     }
-    
-    retVal = build.CreateZExt(retVal, llvm::Type::getInt32Ty(ctx.mGlobal));
 	
 	return retVal;
 }
@@ -377,13 +463,14 @@ AST_EMIT(ASTBinaryMathOp)
 	
 	// PA3: Implement
     
-    // build IR
-    IRBuilder<> build(ctx.mBlock);
-    
     // build expressions for lhs and rhs
+    // (before the builder, since they can add blocks)
     Value* lhs = mLHS->emitIR(ctx);
     Value* rhs = mRHS->emitIR(ctx);
     
+    // build IR
+    IRBuilder<> build(ctx.mBlock);
+    
     // build instruction
     if (mOp == scan::Token::Tokens::Plus) {
         retVal = build.CreateAdd(lhs, rhs);
@@ -411,15 +498,32 @@ AST_EMIT(ASTNotExpr)
 	
 	// PA3: Implement
     
-    IRBuilder<> build(ctx.mBlock);
+    retVal = emitCondition(ctx);
     
-    retVal = build.CreateICmpEQ(mExpr->emitIR(ctx), ctx.mZero);
+    IRBuilder<> build(ctx.mBlock);
     retVal = build.CreateZExt(retVal, llvm::Type::getInt32Ty(ctx.mGlobal));
-//    retVal = build.CreateNot(retVal);
 	
 	return retVal;
 }
 
+// Emits the expression as a condition, which is an i1 that's true
+// if the value is nonzero
+Value* ASTNotExpr::emitCondition(CodeContext& ctx) noexcept
+{
+	Value* cond = mExpr->emitCondition(ctx);
+	
+	// If the operand is a new comparison, it can just be reversed
+	ICmpInst* cmp = dyn_cast<ICmpInst>(cond);
+	if (cmp != nullptr && cmp->use_empty())
+	{
+		cmp->setPredicate(cmp->getInversePredicate());
+		return cmp;
+	}
+	
+	IRBuilder<> build(ctx.mBlock);
+	return build.CreateNot(cond);
+}
+
 // Factor -->
 AST_EMIT(ASTConstantExpr)
 {
@@ -442,7 +546,7 @@ AST_EMIT(ASTConstantExpr)
 
 AST_EMIT(ASTStringExpr)
 {
-	return mString->getValue();
+	return ctx.mStrValues[mString];
 }
 
 AST_EMIT(ASTIdentExpr)
@@ -497,17 +601,29 @@ AST_EMIT(ASTFuncExpr)
 		callList.push_back(argValue);
 	}
 	
+	// Look up the function in this module (printf is always declared,
+	// but a function from another shard might not be yet)
+	Function* func = nullptr;
+	if (mIdent.getFunction())
+	{
+		func = mIdent.getFunction()->emitDeclaration(ctx);
+	}
+	else
+	{
+		func = ctx.mModule->getFunction(mIdent.getName());
+	}
+	
 	// Now call the function, and return it
 	Value* retVal = nullptr;
 	
 	IRBuilder<> build(ctx.mBlock);
 	if (mType != Type::Void)
 	{
-		retVal = build.CreateCall(mIdent.getAddress(), callList, "call");
+		retVal = build.CreateCall(func, callList, "call");
 	}
 	else
 	{
-		retVal = build.CreateCall(mIdent.getAddress(), callList);
+		retVal = build.CreateCall(func, callList);
 	}
 	
 	return retVal;
@@ -577,6 +693,14 @@ AST_EMIT(ASTToIntExpr)
 	return build.CreateSExt(exprVal, llvm::Type::getInt32Ty(ctx.mGlobal), "conv");
 }
 
+// Emits the expression as a condition, which is an i1 that's true
+// if the value is nonzero
+Value* ASTToIntExpr::emitCondition(CodeContext& ctx) noexcept
+{
+	// Extending doesn't change whether it's zero
+	return mExpr->emitCondition(ctx);
+}
+
 AST_EMIT(ASTToCharExpr)
 {
 	Value* exprVal = mExpr->emitIR(ctx);
@@ -625,6 +749,26 @@ AST_EMIT(ASTCompoundStmt)
 {
 	// PA3: Implement
     
+    // The arrays of a nested scope are only live while it runs, which the
+    // code generator uses to share stack slots between disjoint scopes
+    // (They're still allocated in the entry block, with the rest)
+    std::vector<Value*> arrays;
+    if (!mIsFuncBody) {
+        for (const auto & decl : mDecls) {
+            Identifier& ident = decl->getIdent();
+            // (The address is the array's alloca, which
+            // arrays passed into a function don't have)
+            if (ident.isArray() && ident.getAddress() != nullptr) {
+                arrays.push_back(ident.getAddress());
+            }
+        }
+        
+        IRBuilder<> build(ctx.mBlock);
+        for (Value* array : arrays) {
+            build.CreateLifetimeStart(array);
+        }
+    }
+    
     // emit all declarations
     for (const auto & decl : mDecls) {
         decl->emitIR(ctx);
@@ -634,6 +778,14 @@ AST_EMIT(ASTCompoundStmt)
     for (const auto & stmt : mStmts) {
         stmt->emitIR(ctx);
     }
+    
+    // (If the scope ended with a return, they're dead anyway)
+    if (!arrays.empty() && ctx.mBlock->getTerminator() == nullptr) {
+        IRBuilder<> build(ctx.mBlock);
+        for (Value* array : arrays) {
+            build.CreateLifetimeEnd(array);
+        }
+    }
 	
 	return nullptr;
 }
@@ -686,9 +838,8 @@ AST_EMIT(ASTIfStmt)
     // predecessor
     {
         IRBuilder<> build(ctx.mBlock);
-        Value* condVal = mExpr->emitIR(ctx);
+        Value* condVal = mExpr->emitCondition(ctx);
         build.SetInsertPoint(ctx.mBlock);
-        condVal = build.CreateTrunc(condVal, llvm::Type::getInt1Ty(ctx.mGlobal)); // not sure?
         if (mElseStmt) {
             build.CreateCondBr(condVal, if_then, if_else);
             ctx.mSSA.sealBlock(if_then);
@@ -731,40 +882,50 @@ AST_EMIT(ASTWhileStmt)
 {
 	// PA3: Implement
     
+    // The loop is emitted in guarded do-while form:
+    //   guard:    if (!cond) goto while.end
+    //   while.preheader: goto while.body
+    //   while.body: body; if (cond) goto while.body (the only latch)
+    //   while.end:
+    // so each iteration only runs the test at the bottom
+    
     // setup
-    BasicBlock* while_cond = BasicBlock::Create(ctx.mGlobal, "while.cond", ctx.mFunc);
-    ctx.mSSA.addBlock(while_cond);
+    BasicBlock* while_preheader = BasicBlock::Create(ctx.mGlobal, "while.preheader", ctx.mFunc);
+    ctx.mSSA.addBlock(while_preheader);
     BasicBlock* while_body = BasicBlock::Create(ctx.mGlobal, "while.body", ctx.mFunc);
     ctx.mSSA.addBlock(while_body);
+    // Only the variables assigned in the loop can need a phi in the header
+    ctx.mSSA.setAssigned(while_body, mAssigned);
     BasicBlock* while_end = BasicBlock::Create(ctx.mGlobal, "while.end", ctx.mFunc);
     ctx.mSSA.addBlock(while_end);
     
-    // predecessor
+    // guard
     {
+        Value* condVal = mExpr->emitCondition(ctx);
         IRBuilder<> build(ctx.mBlock);
-        build.CreateBr(while_cond);
+        build.CreateCondBr(condVal, while_preheader, while_end);
+        ctx.mSSA.sealBlock(while_preheader);
     }
     
-    // while.cond
+    // while.preheader
     {
-        ctx.mBlock = while_cond;
-        IRBuilder<> build(ctx.mBlock);
-        Value* condVal = mExpr->emitIR(ctx);
-        build.SetInsertPoint(ctx.mBlock);
-        condVal = build.CreateTrunc(condVal, llvm::Type::getInt1Ty(ctx.mGlobal)); // not sure?
-        build.CreateCondBr(condVal, while_body, while_end);
-        ctx.mSSA.sealBlock(while_body);
-        ctx.mSSA.sealBlock(while_end);
+        IRBuilder<> build(while_preheader);
+        build.CreateBr(while_body);
     }
     
     // while.body
     {
         ctx.mBlock = while_body;
-        IRBuilder<> build(ctx.mBlock);
         mLoopStmt->emitIR(ctx);
-        build.SetInsertPoint(ctx.mBlock);
-        build.CreateBr(while_cond);
-        ctx.mSSA.sealBlock(while_cond);
+        
+        // The test at the bottom (unless the body always returns)
+        if (ctx.mBlock->getTerminator() == nullptr) {
+            Value* condVal = mExpr->emitCondition(ctx);
+            IRBuilder<> build(ctx.mBlock);
+            build.CreateCondBr(condVal, while_body, while_end);
+        }
+        ctx.mSSA.sealBlock(while_body);
+        ctx.mSSA.sealBlock(while_end);
     }
     
     // while.end
@@ -772,7 +933,6 @@ AST_EMIT(ASTWhileStmt)
         ctx.mBlock = while_end;
     }
     
-    
 	return nullptr;
 }
 
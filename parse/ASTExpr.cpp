@@ -135,3 +135,47 @@ void ASTFuncExpr::addArg(std::shared_ptr<ASTExpr> arg) noexcept
 {
 	mArgs.push_back(arg);
 }
+
+// Returns true if evaluating the expression has no side effects and
+// can't trap, so it's safe to evaluate even if the program wouldn't
+// (such as the rhs of && and ||)
+bool ASTLogicalAnd::isSpeculatable() const noexcept
+{
+	return mLHS->isSpeculatable() && mRHS->isSpeculatable();
+}
+
+bool ASTLogicalOr::isSpeculatable() const noexcept
+{
+	return mLHS->isSpeculatable() && mRHS->isSpeculatable();
+}
+
+bool ASTBinaryCmpOp::isSpeculatable() const noexcept
+{
+	return mLHS->isSpeculatable() && mRHS->isSpeculatable();
+}
+
+bool ASTBinaryMathOp::isSpeculatable() const noexcept
+{
+	// Division can trap on a zero divisor
+	if (mOp == scan::Token::Div || mOp == scan::Token::Mod)
+	{
+		return false;
+	}
+	
+	return mLHS->isSpeculatable() && mRHS->isSpeculatable();
+}
+
+bool ASTNotExpr::isSpeculatable() const noexcept
+{
+	return mExpr->isSpeculatable();
+}
+
+bool ASTToIntExpr::isSpeculatable() const noexcept
+{
+	return mExpr->isSpeculatable();
+}
+
+bool ASTToCharExpr::isSpeculatable() const noexcept
+{
+	return mExpr->isSpeculatable();
+}
@@ -26,16 +26,20 @@
 
 #include "Types.h"
 #include "Symbols.h"
+#include "MemReport.h"
 #include "../scan/Tokens.h"
 
 // Macro so I don't have to copy/paste over and over
+// (This also counts the node for -fmem-report)
 #define AST_DECL_PRINT_EMIT() \
 virtual void printNode(std::ostream& output, int depth = 0) const noexcept override; \
-virtual llvm::Value* emitIR(CodeContext& ctx) noexcept override;
+virtual llvm::Value* emitIR(CodeContext& ctx) noexcept override; \
+MemTracker mMemTracker{MemReport::ASTNodes, sizeof(*this)};
 
 namespace llvm
 {
 	class Value;
+	class Function;
 }
 
 namespace uscc
@@ -63,9 +67,22 @@ class ASTProgram : public ASTNode
 {
 public:
 	void addFunction(std::shared_ptr<ASTFunction> func) noexcept;
+	
+	size_t getNumFunctions() const noexcept
+	{
+		return mFuncs.size();
+	}
+	
+	// Creates the module, and emits the string table and
+	// the declaration for printf (if it's needed)
+	void emitGlobals(CodeContext& ctx) noexcept;
+	
+	// Emits the functions in the range [begin, end)
+	void emitFunctions(CodeContext& ctx, size_t begin, size_t end) noexcept;
+	
 	AST_DECL_PRINT_EMIT();
 private:
-	std::list<std::shared_ptr<ASTFunction>> mFuncs;
+	std::vector<std::shared_ptr<ASTFunction>> mFuncs;
 };
 	
 // Function AST Nodes
@@ -105,6 +122,11 @@ public:
 	
 	Type getArgType(unsigned int argNum) const noexcept;
 	
+	// Returns this function in the current module, and declares
+	// it if it isn't there yet (which is the case when it's
+	// called from a different shard of the program)
+	llvm::Function* emitDeclaration(CodeContext& ctx) noexcept;
+	
 	AST_DECL_PRINT_EMIT();
 private:
 	std::shared_ptr<ASTCompoundStmt> mBody;
@@ -148,6 +170,18 @@ public:
 	{
 		return mType;
 	}
+	
+	// Returns true if evaluating the expression has no side effects and
+	// can't trap, so it's safe to evaluate even if the program wouldn't
+	// (such as the rhs of && and ||)
+	virtual bool isSpeculatable() const noexcept
+	{
+		return false;
+	}
+	
+	// Emits the expression as a condition, which is an i1 that's true
+	// if the value is nonzero. (By default, this compares it to zero.)
+	virtual llvm::Value* emitCondition(CodeContext& ctx) noexcept;
 protected:
 	// All expressions have a type
 	// (used for semantic evaluation)
@@ -201,6 +235,9 @@ public:
 	// Returns false if this is an invalid operation.
 	bool finalizeOp() noexcept;
 	
+	bool isSpeculatable() const noexcept override;
+	llvm::Value* emitCondition(CodeContext& ctx) noexcept override;
+	
 	AST_DECL_PRINT_EMIT();
 private:
 	std::shared_ptr<ASTExpr> mLHS;
@@ -226,6 +263,9 @@ public:
 	// Returns false if this is an invalid operation.
 	bool finalizeOp() noexcept;
 	
+	bool isSpeculatable() const noexcept override;
+	llvm::Value* emitCondition(CodeContext& ctx) noexcept override;
+	
 	AST_DECL_PRINT_EMIT();
 private:
 	std::shared_ptr<ASTExpr> mLHS;
@@ -255,6 +295,9 @@ public:
 	// Returns false if this is an invalid operation.
 	bool finalizeOp() noexcept;
 	
+	bool isSpeculatable() const noexcept override;
+	llvm::Value* emitCondition(CodeContext& ctx) noexcept override;
+	
 	AST_DECL_PRINT_EMIT();
 private:
 	scan::Token::Tokens mOp;
@@ -285,6 +328,8 @@ public:
 	// Returns false if this is an invalid operation.
 	bool finalizeOp() noexcept;
 	
+	bool isSpeculatable() const noexcept override;
+	
 	AST_DECL_PRINT_EMIT();
 private:
 	scan::Token::Tokens mOp;
@@ -303,6 +348,9 @@ public:
 	{
 		mType = mExpr->getType();
 	}
+	bool isSpeculatable() const noexcept override;
+	llvm::Value* emitCondition(CodeContext& ctx) noexcept override;
+	
 	AST_DECL_PRINT_EMIT();
 private:
 	std::shared_ptr<ASTExpr> mExpr;
@@ -329,6 +377,11 @@ public:
 		mType = Type::Char;
 	}
 	
+	bool isSpeculatable() const noexcept override
+	{
+		return true;
+	}
+	
 	AST_DECL_PRINT_EMIT();
 private:
 	int mValue;
@@ -343,6 +396,11 @@ public:
 		return mString->getText().size();
 	}
 	
+	bool isSpeculatable() const noexcept override
+	{
+		return true;
+	}
+	
 	AST_DECL_PRINT_EMIT();
 private:
 	ConstStr* mString;
@@ -356,6 +414,11 @@ public:
 	{
 		mType = mIdent.getType();
 	}
+	bool isSpeculatable() const noexcept override
+	{
+		return true;
+	}
+	
 	AST_DECL_PRINT_EMIT();
 private:
 	Identifier& mIdent;
@@ -467,6 +530,9 @@ public:
 		return mExpr;
 	}
 	
+	bool isSpeculatable() const noexcept override;
+	llvm::Value* emitCondition(CodeContext& ctx) noexcept override;
+	
 	AST_DECL_PRINT_EMIT();
 private:
 	std::shared_ptr<ASTExpr> mExpr;
@@ -487,6 +553,8 @@ public:
 		return mExpr;
 	}
 	
+	bool isSpeculatable() const noexcept override;
+	
 	AST_DECL_PRINT_EMIT();
 private:
 	std::shared_ptr<ASTExpr> mExpr;
@@ -500,6 +568,12 @@ public:
 	: mIdent(ident)
 	, mExpr(expr)
 	{ }
+	
+	Identifier& getIdent() noexcept
+	{
+		return mIdent;
+	}
+	
 	AST_DECL_PRINT_EMIT();
 private:
 	Identifier& mIdent;
@@ -515,6 +589,9 @@ class ASTStmt : public ASTNode
 class ASTCompoundStmt : public ASTStmt
 {
 public:
+	ASTCompoundStmt(bool isFuncBody = false) noexcept
+	: mIsFuncBody(isFuncBody)
+	{ }
 	AST_DECL_PRINT_EMIT();
 	void addDecl(std::shared_ptr<ASTDecl> decl) noexcept;
 	void addStmt(std::shared_ptr<ASTStmt> stmt) noexcept;
@@ -522,6 +599,8 @@ public:
 private:
 	std::list<std::shared_ptr<ASTDecl>> mDecls;
 	std::list<std::shared_ptr<ASTStmt>> mStmts;
+	// The declarations of a function body live as long as the function
+	bool mIsFuncBody;
 };
 
 class ASTAssignStmt : public ASTStmt
@@ -575,9 +654,14 @@ public:
 	, mLoopStmt(loopStmt)
 	{ }
 	AST_DECL_PRINT_EMIT();
+	// Sets the identifiers that are assigned in the condition or body
+	void setAssigned(std::vector<Identifier*>::const_iterator begin,
+					 std::vector<Identifier*>::const_iterator end) noexcept;
 private:
 	std::shared_ptr<ASTExpr> mExpr;
 	std::shared_ptr<ASTStmt> mLoopStmt;
+	// Sorted, so the SSA builder can search it
+	std::vector<Identifier*> mAssigned;
 };
 	
 class ASTReturnStmt : public ASTStmt
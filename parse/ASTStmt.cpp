@@ -13,6 +13,7 @@
 //---------------------------------------------------------
 
 #include "ASTNodes.h"
+#include <algorithm>
 
 using namespace uscc::parse;
 
@@ -39,3 +40,12 @@ shared_ptr<ASTStmt> ASTCompoundStmt::getLastStmt() noexcept
 		return nullptr;
 	}
 }
+
+// Sets the identifiers that are assigned in the condition or body
+void ASTWhileStmt::setAssigned(std::vector<Identifier*>::const_iterator begin,
+							   std::vector<Identifier*>::const_iterator end) noexcept
+{
+	mAssigned.assign(begin, end);
+	std::sort(mAssigned.begin(), mAssigned.end());
+	mAssigned.erase(std::unique(mAssigned.begin(), mAssigned.end()), mAssigned.end());
+}
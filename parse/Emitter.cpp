@@ -16,6 +16,10 @@
 
 #include "Emitter.h"
 #include "Parse.h"
+#include "TimeTrace.h"
+#include <algorithm>
+#include <string>
+#include <thread>
 
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wconversion"
@@ -24,6 +28,9 @@
 #include <llvm/IR/IRPrintingPasses.h>
 #include <llvm/IR/LegacyPassManager.h>
 #include <llvm/Bitcode/BitcodeWriterPass.h>
+#include <llvm/Bitcode/ReaderWriter.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/Support/MemoryBuffer.h>
 #include <llvm/Support/raw_ostream.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Constants.h>
@@ -47,20 +54,66 @@
 using namespace uscc::parse;
 using namespace llvm;
 
-CodeContext::CodeContext(StringTable& strings)
-: mGlobal(getGlobalContext())
+namespace
+{
+	// Calls func(i) for each i in [0, count), each on its own thread,
+	// and waits for all of them to finish
+	template <typename Func>
+	void runOnThreads(size_t count, Func func)
+	{
+		std::vector<std::thread> threads;
+		for (size_t i = 0; i < count; i++)
+		{
+			threads.emplace_back(func, i);
+		}
+		
+		for (auto& t : threads)
+		{
+			t.join();
+		}
+	}
+}
+
+CodeContext::CodeContext(StringTable& strings, LLVMContext& global)
+: mGlobal(global)
 , mModule(nullptr)
 , mBlock(nullptr)
 , mStrings(strings)
 , mPrintfIdent(nullptr)
 , mZero(nullptr)
 , mFunc(nullptr)
+, mIsShard(false)
 {
 	
 }
 
-Emitter::Emitter(Parser& parser) noexcept
-: mContext(parser.mStrings)
+// A module with some of the functions, in its own LLVM context
+struct Emitter::Shard
+{
+	Shard(StringTable& strings)
+	: mGlobal(new LLVMContext)
+	, mContext(strings, *mGlobal)
+	{
+		mContext.mIsShard = true;
+	}
+	
+	~Shard()
+	{
+		// (The module has to go before its context)
+		delete mContext.mModule;
+	}
+	
+	std::unique_ptr<LLVMContext> mGlobal;
+	CodeContext mContext;
+	
+	// The module, written as bitcode so it can be read
+	// into the main context
+	std::string mBitcode;
+};
+
+Emitter::Emitter(Parser& parser, unsigned jobs /* = 1 */) noexcept
+: mContext(parser.mStrings, getGlobalContext())
+, mLinkFailed(false)
 {
 	if (parser.mNeedPrintf)
 	{
@@ -70,35 +123,207 @@ Emitter::Emitter(Parser& parser) noexcept
 	// Initialize zero
 	mContext.mZero = Constant::getNullValue(IntegerType::getInt32Ty(mContext.mGlobal));
 	
-	// This is what kicks off the generation of the LLVM IR from the AST
-	parser.mRoot->emitIR(mContext);
+	size_t numFuncs = parser.mRoot->getNumFunctions();
+	size_t numShards = std::min<size_t>(jobs, numFuncs);
+	if (numShards <= 1)
+	{
+		// This is what kicks off the generation of the LLVM IR from the AST
+		parser.mRoot->emitIR(mContext);
+		return;
+	}
+	
+	TimeScope timer("EmitProgram");
+	
+	// The main module only has the globals. The shards are linked
+	// into it in order, so the functions end up in the same order
+	// as if they were emitted serially.
+	parser.mRoot->emitGlobals(mContext);
+	
+	for (size_t i = 0; i < numShards; i++)
+	{
+		mShards.emplace_back(new Shard(parser.mStrings));
+	}
+	
+	ASTProgram& program = *parser.mRoot;
+	runOnThreads(numShards, [this, &program, numFuncs, numShards](size_t i) {
+		TimeScope timer("EmitShard");
+		
+		CodeContext& ctx = mShards[i]->mContext;
+		ctx.mPrintfIdent = mContext.mPrintfIdent;
+		ctx.mZero = Constant::getNullValue(IntegerType::getInt32Ty(ctx.mGlobal));
+		
+		// Each shard gets a contiguous range of the functions
+		size_t begin = numFuncs * i / numShards;
+		size_t end = numFuncs * (i + 1) / numShards;
+		program.emitGlobals(ctx);
+		program.emitFunctions(ctx, begin, end);
+	});
+}
+
+Emitter::~Emitter() noexcept
+{
+	
 }
 
-void Emitter::optimize() noexcept
+void Emitter::optimize(const opt::OptOptions& options) noexcept
 {
+	// (Each pass also times itself, per function)
+	TimeScope timer("Optimize");
+	
+	if (!mShards.empty())
+	{
+		// All of the passes are function or loop passes, so optimizing
+		// the shards separately gives the same result
+		runOnThreads(mShards.size(), [this, &options](size_t i) {
+			legacy::PassManager pm;
+			uscc::opt::registerOptPasses(pm, options);
+			pm.run(*mShards[i]->mContext.mModule);
+		});
+		return;
+	}
+	
 	legacy::PassManager pm;
-	uscc::opt::registerOptPasses(pm);
+	uscc::opt::registerOptPasses(pm, options);
 	pm.run(*mContext.mModule);
 }
 
+// Returns the shards' modules (or the main module, if there are
+// no shards) without linking them
+std::vector<Module*> Emitter::getModules() noexcept
+{
+	std::vector<Module*> modules;
+	for (auto& shard : mShards)
+	{
+		modules.push_back(shard->mContext.mModule);
+	}
+	
+	if (modules.empty())
+	{
+		modules.push_back(mContext.mModule);
+	}
+	return modules;
+}
+
+// Links the shards (if there are any) into the main module.
+// Returns false (after printing the error) if a shard couldn't
+// be linked, in which case the module is incomplete.
+bool Emitter::linkShards() noexcept
+{
+	if (mShards.empty())
+	{
+		return !mLinkFailed;
+	}
+	
+	TimeScope timer("Link");
+	
+	// Modules can't be linked across contexts, so each shard
+	// is written to bitcode on its own thread...
+	runOnThreads(mShards.size(), [this](size_t i) {
+		Shard& shard = *mShards[i];
+		raw_string_ostream stream(shard.mBitcode);
+		WriteBitcodeToFile(shard.mContext.mModule, stream);
+		stream.flush();
+	});
+	
+	// ...and read back into the main context. While linking, the
+	// strings need to be external so the shards' declarations of
+	// them resolve to the definitions in the main module.
+	for (auto& str : mContext.mStrValues)
+	{
+		cast<GlobalValue>(str.second)->setLinkage(GlobalValue::ExternalLinkage);
+	}
+	
+	// (The rest of the shards aren't linked after a failure, since the
+	// module is missing the failed shard's functions either way)
+	for (auto& shard : mShards)
+	{
+		std::unique_ptr<MemoryBuffer> buffer(MemoryBuffer::getMemBuffer(shard->mBitcode, "", false));
+		ErrorOr<Module*> module = parseBitcodeFile(buffer.get(), mContext.mGlobal);
+		if (!module)
+		{
+			errs() << "uscc: error: Unable to read shard: " << module.getError().message() << "\n";
+			mLinkFailed = true;
+			break;
+		}
+		
+		std::string err;
+		if (Linker::LinkModules(mContext.mModule, module.get(), Linker::DestroySource, &err))
+		{
+			errs() << "uscc: error: Unable to link shard: " << err << "\n";
+			mLinkFailed = true;
+		}
+		delete module.get();
+		
+		if (mLinkFailed)
+		{
+			break;
+		}
+	}
+	
+	for (auto& str : mContext.mStrValues)
+	{
+		cast<GlobalValue>(str.second)->setLinkage(GlobalValue::PrivateLinkage);
+	}
+	
+	mShards.clear();
+	return !mLinkFailed;
+}
+
 void Emitter::print() noexcept
 {
+	if (!linkShards())
+	{
+		return;
+	}
+	
 	legacy::PassManager pm;
 	pm.add(createPrintModulePass(outs()));
 	pm.run(*mContext.mModule);
 }
 
-void Emitter::writeBitcode(const char* fileName) noexcept
+bool Emitter::writeBitcode(const char* fileName) noexcept
 {
-	legacy::PassManager pm;
+	if (!linkShards())
+	{
+		return false;
+	}
+	
+	TimeScope timer("WriteBitcode", fileName);
+	
 	std::string err;
 	raw_fd_ostream file(fileName, err, sys::fs::F_None);
+	if (!err.empty())
+	{
+		errs() << "uscc: error: Unable to open " << fileName << ": " << err << "\n";
+		return false;
+	}
+	
+	legacy::PassManager pm;
 	pm.add(createBitcodeWriterPass(file));
 	pm.run(*mContext.mModule);
+	
+	// (The error has to be cleared, or the stream reports it again when it's destroyed)
+	file.close();
+	if (file.has_error())
+	{
+		file.clear_error();
+		errs() << "uscc: error: Unable to write " << fileName << "\n";
+		return false;
+	}
+	return true;
 }
 
 bool Emitter::verify() noexcept
 {
+	// (A module that's missing shards still verifies,
+	// since their functions are declared)
+	if (!linkShards())
+	{
+		return false;
+	}
+	
+	TimeScope timer("Verify");
+	
 	return !verifyModule(*mContext.mModule);
 }
 
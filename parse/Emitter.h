@@ -22,6 +22,10 @@
 
 #include "Types.h"
 #include "../opt/SSABuilder.h"
+#include "../opt/OptOptions.h"
+#include <memory>
+#include <unordered_map>
+#include <vector>
 
 namespace uscc
 {
@@ -30,15 +34,18 @@ namespace parse
 
 class StringTable;
 class Identifier;
+class ConstStr;
 
 struct CodeContext
 {
-	CodeContext(StringTable& strings);
+	CodeContext(StringTable& strings, llvm::LLVMContext& global);
 	
 	// Used for our SSA construction algorithm
 	opt::SSABuilder mSSA;
 	
 	// Global context for LLVM
+	// (Each shard has its own, since a context can only be
+	// used by one thread at a time)
 	llvm::LLVMContext& mGlobal;
 	
 	// Module for this program
@@ -50,6 +57,9 @@ struct CodeContext
 	// String table
 	StringTable& mStrings;
 	
+	// Maps each string to its global variable in this module
+	std::unordered_map<ConstStr*, llvm::Value*> mStrValues;
+	
 	// This will be non-null if we need extern printf
 	Identifier* mPrintfIdent;
 	
@@ -58,6 +68,10 @@ struct CodeContext
 	
 	// stores the current function
 	llvm::Function* mFunc;
+	
+	// True if this module only has some of the functions, and
+	// will be linked into the main module
+	bool mIsShard;
 };
 
 class Parser;
@@ -65,14 +79,41 @@ class Parser;
 class Emitter
 {
 public:
-	Emitter(Parser& parser) noexcept;
-	void optimize() noexcept;
+	// If jobs is more than 1, the functions are split into that many
+	// shards, which are emitted and optimized on their own threads.
+	// The shards are linked into one module the first time it's used.
+	Emitter(Parser& parser, unsigned jobs = 1) noexcept;
+	~Emitter() noexcept;
+	void optimize(const opt::OptOptions& options = opt::OptOptions()) noexcept;
 	void print() noexcept;
-	void writeBitcode(const char* fileName) noexcept;
+	bool writeBitcode(const char* fileName) noexcept;
 	bool verify() noexcept;
 	bool writeAsm(const char* fileName) noexcept;
+	
+	llvm::Module* getModule() noexcept
+	{
+		linkShards();
+		return mContext.mModule;
+	}
+	
+	// Returns the shards' modules (or the main module, if there are
+	// no shards) without linking them
+	std::vector<llvm::Module*> getModules() noexcept;
+	
+	// Links the shards (if there are any) into the main module.
+	// Returns false (after printing the error) if a shard couldn't
+	// be linked, in which case the module is incomplete.
+	bool linkShards() noexcept;
 private:
+	struct Shard;
+	
 	CodeContext mContext;
+	
+	// The shards that haven't been linked yet
+	std::vector<std::unique_ptr<Shard>> mShards;
+	
+	// True if linking the shards failed
+	bool mLinkFailed;
 };
 
 } // uscc
@@ -0,0 +1,186 @@
+//
+//  MemReport.cpp
+//  uscc
+//
+//  Implements the memory accounting used by -fmem-report.
+//
+//---------------------------------------------------------
+//  Copyright (c) 2014, Sanjay Madhav
+//  All rights reserved.
+//
+//  This file is distributed under the BSD license.
+//  See LICENSE.TXT for details.
+//---------------------------------------------------------
+
+#include "MemReport.h"
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wconversion"
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/Instruction.h>
+#include <llvm/IR/Use.h>
+#pragma clang diagnostic pop
+
+#include <iomanip>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+using namespace uscc::parse;
+
+namespace
+{
+	const char* categoryNames[MemReport::NumCategories] =
+	{
+		"AST nodes",
+		"Identifiers",
+		"Scope tables",
+		"String table entries",
+		"SSA map entries",
+	};
+
+	// Returns the peak resident set size of uscc in bytes
+	// (or 0 if it can't be determined on this platform)
+	size_t getPeakRSS()
+	{
+#ifndef _WIN32
+		struct rusage usage;
+		if (getrusage(RUSAGE_SELF, &usage) != 0)
+		{
+			return 0;
+		}
+#ifdef __APPLE__
+		// Mac reports this in bytes...
+		return static_cast<size_t>(usage.ru_maxrss);
+#else
+		// ...but Linux reports it in kilobytes
+		return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#else
+		return 0;
+#endif
+	}
+
+	void printRow(std::ostream& output, const char* name, size_t count, size_t bytes)
+	{
+		output << "  " << std::left << std::setw(24) << name << std::right;
+		output << std::setw(12) << count << std::setw(14) << bytes << '\n';
+	}
+}
+
+MemReport::MemReport() noexcept
+: mEnabled(false)
+{
+	for (int i = 0; i < NumCategories; i++)
+	{
+		mCounts[i] = 0;
+		mBytes[i] = 0;
+	}
+}
+
+// Returns the report for this compilation
+MemReport& MemReport::get() noexcept
+{
+	static MemReport report;
+	return report;
+}
+
+// Records the end of a phase. If the module is non-null,
+// the LLVM instructions/blocks in it are also counted.
+void MemReport::snapshot(const char* phase, const std::vector<llvm::Module*>& modules) noexcept
+{
+	if (!mEnabled)
+	{
+		return;
+	}
+
+	Snapshot s;
+	s.mPhase = phase;
+	for (int i = 0; i < NumCategories; i++)
+	{
+		s.mCounts[i] = mCounts[i];
+		s.mBytes[i] = mBytes[i];
+	}
+	s.mInstructions = 0;
+	s.mInstructionBytes = 0;
+	s.mBlocks = 0;
+	s.mBlockBytes = 0;
+	s.mPeakRSS = getPeakRSS();
+	s.mHasModule = !modules.empty();
+
+	for (llvm::Module* module : modules)
+	{
+		// LLVM doesn't expose its allocation sizes, so this is the
+		// size of the objects plus their operand lists
+		for (llvm::Function& func : *module)
+		{
+			for (llvm::BasicBlock& block : func)
+			{
+				s.mBlocks++;
+				s.mBlockBytes += sizeof(llvm::BasicBlock);
+				for (llvm::Instruction& instr : block)
+				{
+					s.mInstructions++;
+					s.mInstructionBytes += sizeof(llvm::Instruction) +
+						instr.getNumOperands() * sizeof(llvm::Use);
+				}
+			}
+		}
+	}
+
+	mSnapshots.push_back(s);
+}
+
+// Prints the per-phase breakdown to the specified stream
+void MemReport::printReport(std::ostream& output) const noexcept
+{
+	output << "===---------------------------------------------------------===\n";
+	output << "                     uscc memory report\n";
+	output << "===---------------------------------------------------------===\n";
+
+	const Snapshot* prev = nullptr;
+	for (const auto& s : mSnapshots)
+	{
+		output << "Phase: " << s.mPhase;
+		if (s.mPeakRSS != 0)
+		{
+			output << " (peak RSS " << std::fixed << std::setprecision(2)
+				   << s.mPeakRSS / (1024.0 * 1024.0) << " MB)";
+		}
+		output << '\n';
+
+		// Allocations are reported for the phase they happened in
+		output << "  " << std::left << std::setw(24) << "Allocated" << std::right;
+		output << std::setw(12) << "Count" << std::setw(14) << "Bytes" << '\n';
+		for (int i = 0; i < NumCategories; i++)
+		{
+			size_t count = s.mCounts[i];
+			size_t bytes = s.mBytes[i];
+			if (prev)
+			{
+				count -= prev->mCounts[i];
+				bytes -= prev->mBytes[i];
+			}
+
+			if (count != 0)
+			{
+				printRow(output, categoryNames[i], count, bytes);
+			}
+		}
+
+		// Whereas the IR is what's live at the end of the phase
+		if (s.mHasModule)
+		{
+			printRow(output, "LLVM instructions", s.mInstructions, s.mInstructionBytes);
+			printRow(output, "LLVM basic blocks", s.mBlocks, s.mBlockBytes);
+		}
+
+		output << '\n';
+		prev = &s;
+	}
+
+	output << std::flush;
+}
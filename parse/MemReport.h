@@ -0,0 +1,110 @@
+//
+//  MemReport.h
+//  uscc
+//
+//  Declares the memory accounting used by -fmem-report.
+//
+//  Compiler data structures add themselves to the global
+//  MemReport as they are allocated, and the driver takes
+//  a snapshot at the end of each phase. Allocations can
+//  be added from any thread.
+//
+//---------------------------------------------------------
+//  Copyright (c) 2014, Sanjay Madhav
+//  All rights reserved.
+//
+//  This file is distributed under the BSD license.
+//  See LICENSE.TXT for details.
+//---------------------------------------------------------
+
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <ostream>
+#include <vector>
+
+namespace llvm
+{
+	class Module;
+}
+
+namespace uscc
+{
+namespace parse
+{
+
+class MemReport
+{
+public:
+	// The data structures uscc tracks allocations for
+	enum Category
+	{
+		ASTNodes,
+		Identifiers,
+		ScopeTables,
+		StringEntries,
+		SSAEntries,
+		NumCategories
+	};
+
+	// Returns the report for this compilation
+	static MemReport& get() noexcept;
+
+	void enable() noexcept
+	{
+		mEnabled = true;
+	}
+
+	bool isEnabled() const noexcept
+	{
+		return mEnabled;
+	}
+
+	// Records an allocation of the specified size in a category
+	void add(Category category, size_t bytes) noexcept
+	{
+		mCounts[category].fetch_add(1, std::memory_order_relaxed);
+		mBytes[category].fetch_add(bytes, std::memory_order_relaxed);
+	}
+
+	// Records the end of a phase. The LLVM instructions/blocks in the
+	// modules (such as the unlinked shards) are also counted.
+	void snapshot(const char* phase,
+				  const std::vector<llvm::Module*>& modules = std::vector<llvm::Module*>()) noexcept;
+
+	// Prints the per-phase breakdown to the specified stream
+	void printReport(std::ostream& output) const noexcept;
+private:
+	MemReport() noexcept;
+
+	struct Snapshot
+	{
+		const char* mPhase;
+		size_t mCounts[NumCategories];
+		size_t mBytes[NumCategories];
+		size_t mInstructions;
+		size_t mInstructionBytes;
+		size_t mBlocks;
+		size_t mBlockBytes;
+		size_t mPeakRSS;
+		bool mHasModule;
+	};
+
+	std::vector<Snapshot> mSnapshots;
+	std::atomic<size_t> mCounts[NumCategories];
+	std::atomic<size_t> mBytes[NumCategories];
+	bool mEnabled;
+};
+
+// Used as a member of classes that should be counted by the MemReport
+// (the AST nodes declare one with AST_DECL_PRINT_EMIT)
+struct MemTracker
+{
+	MemTracker(MemReport::Category category, size_t bytes) noexcept
+	{
+		MemReport::get().add(category, bytes);
+	}
+};
+
+} // parse
+} // uscc
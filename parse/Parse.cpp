@@ -17,6 +17,7 @@
 #include "Parse.h"
 #include <FlexLexer.h>
 #include "Symbols.h"
+#include "TimeTrace.h"
 
 // Used if you want to see each token
 #define DEBUG_PRINT_TOKENS 0
@@ -114,6 +115,14 @@ void Parser::consumeToken(bool unknownIsExcept)
 		}
 	}
 	
+	// Lexing is interleaved with parsing, so it's only tracked as a total
+	bool timeLexer = TimeTrace::get().isEnabled();
+	TimeTrace::Clock::time_point lexStart;
+	if (timeLexer)
+	{
+		lexStart = TimeTrace::Clock::now();
+	}
+	
 	do
 	{
 		mCurrToken = static_cast<Token::Tokens>(mLexer->yylex());
@@ -157,6 +166,11 @@ void Parser::consumeToken(bool unknownIsExcept)
 	while(mCurrToken == Token::Newline || mCurrToken == Token::Comment ||
 		  mCurrToken == Token::Space || mCurrToken == Token::Tab ||
 		  mCurrToken == Token::Unknown);
+	
+	if (timeLexer)
+	{
+		TimeTrace::get().addTotal("Lex", TimeTrace::Clock::now() - lexStart);
+	}
 }
 
 // Sees if the token matches the requested.
@@ -456,6 +470,8 @@ std::shared_ptr<ASTExpr> Parser::intToChar(std::shared_ptr<ASTExpr> expr) noexce
 // The entry point for the parser
 shared_ptr<ASTProgram> Parser::parseProgram()
 {
+	TimeScope timer("ParseProgram", mFileName);
+	
 	// Create our base program node.
 	shared_ptr<ASTProgram> retVal = make_shared<ASTProgram>();
 	
@@ -494,6 +510,10 @@ shared_ptr<ASTFunction> Parser::parseFunction()
 	// Check for a return type
 	if (peekIsOneOf({Token::Key_void, Token::Key_int, Token::Key_char}))
 	{
+		// Parsing and semantic checks happen in the same pass,
+		// so this covers both
+		TimeScope timer("ParseFunction");
+		
 		Type retType;
 		
 		switch(peekToken())
@@ -511,6 +531,7 @@ shared_ptr<ASTFunction> Parser::parseFunction()
 		}
 		
 		mCurrReturnType = retType;
+		mAssigned.clear();
 		
 		consumeToken();
 		
@@ -565,6 +586,7 @@ shared_ptr<ASTFunction> Parser::parseFunction()
 			{
 				ident = mSymbols.createIdentifier(getTokenTxt());
 				ident->setType(Type::Function);
+				timer.setDetail(ident->getName());
 				
 				if (ident->getName() == "main" && retType != Type::Int)
 				{
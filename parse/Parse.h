@@ -254,6 +254,10 @@ private:
 	// Tracks the return type of the current function
 	Type mCurrReturnType;
 	
+	// The identifiers assigned in the current function, in the order
+	// they're parsed (so a while loop's are the ones added while it's parsed)
+	std::vector<Identifier*> mAssigned;
+	
 	// Current active token
 	uscc::scan::Token::Tokens mCurrToken;
 	
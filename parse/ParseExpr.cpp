@@ -791,7 +791,9 @@ shared_ptr<ASTExpr> Parser::parseIncFactor()
     
     if (peekToken() == Token::Inc) {
         consumeToken();
-        retVal = make_shared<ASTIncExpr>(*getVariable(getTokenTxt()));
+        Identifier* ident = getVariable(getTokenTxt());
+        mAssigned.push_back(ident);
+        retVal = make_shared<ASTIncExpr>(*ident);
         consumeToken();
     }
     
@@ -809,7 +811,9 @@ shared_ptr<ASTExpr> Parser::parseDecFactor()
     
     if (strcmp(getTokenTxt(), "--") == 0) {
         consumeToken();
-        retVal = make_shared<ASTDecExpr>(*getVariable(getTokenTxt()));
+        Identifier* ident = getVariable(getTokenTxt());
+        mAssigned.push_back(ident);
+        retVal = make_shared<ASTDecExpr>(*ident);
         consumeToken();
     }
     
@@ -183,6 +183,11 @@ shared_ptr<ASTDecl> Parser::parseDecl()
 			
 			matchToken(Token::SemiColon);
 			
+			if (assignExpr)
+			{
+				mAssigned.push_back(ident);
+			}
+			
 			retVal = make_shared<ASTDecl>(*ident, assignExpr);
 		}
 		catch (ParseExcept& e)
@@ -285,7 +290,7 @@ shared_ptr<ASTCompoundStmt> Parser::parseCompoundStmt(const bool isFuncBody)
         
         consumeToken();
         
-        retVal = make_shared<ASTCompoundStmt>();
+        retVal = make_shared<ASTCompoundStmt>(isFuncBody);
     
         // Parse declarations
         // if the next token is a VarType, then it's a declaration
@@ -442,6 +447,7 @@ shared_ptr<ASTStmt> Parser::parseAssignStmt()
                     reportSemantError(err, col);
                 }
 				
+				mAssigned.push_back(ident);
 				retVal = make_shared<ASTAssignStmt>(*ident, expr);
 			}
 			
@@ -528,6 +534,9 @@ shared_ptr<ASTWhileStmt> Parser::parseWhileStmt()
     shared_ptr<ASTExpr> expr;
     shared_ptr<ASTStmt> stmt;
     
+    // Everything assigned from here on is in the loop
+    size_t firstAssigned = mAssigned.size();
+    
     // while
     if (peekToken() == Token::Key_while) {
         consumeToken();
@@ -550,6 +559,8 @@ shared_ptr<ASTWhileStmt> Parser::parseWhileStmt()
                     
                     if (stmt) {
                         retVal = make_shared<ASTWhileStmt>(expr, stmt);
+                        retVal->setAssigned(mAssigned.begin() + firstAssigned,
+                                            mAssigned.end());
                     }
                 }
             }
@@ -33,10 +33,9 @@
 
 using namespace uscc::parse;
 
-llvm::Type* Identifier::llvmType(bool treatArrayAsPtr /* = true */) noexcept
+llvm::Type* Identifier::llvmType(llvm::LLVMContext& context, bool treatArrayAsPtr /* = true */) noexcept
 {
 	llvm::Type* type = nullptr;
-	llvm::LLVMContext& context = llvm::getGlobalContext();
 	switch (mType)
 	{
 		case Type::Char:
@@ -231,6 +230,8 @@ void SymbolTable::exitScope()
 SymbolTable::ScopeTable::ScopeTable(ScopeTable* parent) noexcept
 : mParent(parent)
 {
+	MemReport::get().add(MemReport::ScopeTables, sizeof(ScopeTable));
+	
 	// PA2: Implement
     
     if (mParent != nullptr) {
@@ -249,7 +250,9 @@ void SymbolTable::ScopeTable::addIdentifier(Identifier* ident)
 {
 	// PA2: Implement
     
-    mSymbols.insert({ident->getName(), ident});
+    if (mSymbols.insert({ident->getName(), ident}).second) {
+        mDeclOrder.push_back(ident);
+    }
 }
 
 // Searches this scope for an identifier with
@@ -286,9 +289,8 @@ void SymbolTable::ScopeTable::emitIR(CodeContext& ctx)
 {
 	// The ONLY thing we should alloca now are arrays of a specified size
 	// First emit all the symbols in this scope
-	for (auto sym : mSymbols)
+	for (Identifier* ident : mDeclOrder)
 	{
-		Identifier* ident = sym.second;
 		llvm::IRBuilder<> build(ctx.mBlock);
 
 		llvm::Value* decl = nullptr;
@@ -299,12 +301,16 @@ void SymbolTable::ScopeTable::emitIR(CodeContext& ctx)
 		// in which case we don't allocate it
 		if (ident->isArray() && ident->getArrayCount() != -1)
 		{
-			llvm::Type* type = ident->llvmType(false);
+			llvm::Type* type = ident->llvmType(ctx.mGlobal, false);
 			// Note we pass in "nullptr" for the array size because that's
 			// handled by the type
 			decl = build.CreateAlloca(type, nullptr, name);
 			llvm::cast<llvm::AllocaInst>(decl)->setAlignment(8);
 			
+			// The alloca is saved for the lifetime markers, since reading
+			// the identifier in a loop can give a phi instead of the GEP
+			ident->setAddress(decl);
+			
 			// Make a GEP here so we can access it later on without issue
 			std::vector<llvm::Value*> gepIdx;
 			gepIdx.push_back(ctx.mZero);
@@ -324,7 +330,7 @@ void SymbolTable::ScopeTable::emitIR(CodeContext& ctx)
 			// (Make sure you check for function arguments, which
 			// will already have a value which we needs to be copied)
             
-            llvm::Type* type = ident->llvmType(true);
+            llvm::Type* type = ident->llvmType(ctx.mGlobal, true);
             decl = build.CreateAlloca(type, nullptr, name);
             if (ident->getAddress() != nullptr) {
                 build.CreateStore(ident->getAddress(), decl);
@@ -408,9 +414,9 @@ StringTable::StringTable() noexcept
 
 StringTable::~StringTable() noexcept
 {
-	for (auto i : mStrings)
+	for (ConstStr* str : mOrder)
 	{
-		delete i.second;
+		delete str;
 	}
 }
 
@@ -428,32 +434,45 @@ ConstStr* StringTable::getString(std::string& val) noexcept
 	{
 		ConstStr* newStr = new ConstStr(val);
 		mStrings.emplace(val, newStr);
+		mOrder.push_back(newStr);
+		MemReport::get().add(MemReport::StringEntries, sizeof(ConstStr) + val.size());
 		return newStr;
 	}
 }
 
 void StringTable::emitIR(CodeContext& ctx) noexcept
 {
-	for (auto s : mStrings)
+	for (ConstStr* str : mOrder)
 	{
-		ConstStr* str = s.second;
-		// Make the llvm value for this string
-		llvm::Constant* strVal = llvm::ConstantDataArray::getString(ctx.mGlobal, str->mText);
-		
 		// Add this to the global table
 		llvm::ArrayType* type = llvm::ArrayType::get(llvm::Type::getInt8Ty(ctx.mGlobal),
 													 str->mText.size() + 1);
 		
 		
-		llvm::GlobalValue* globVal =
-			new llvm::GlobalVariable(*ctx.mModule, type, true,
-									 llvm::GlobalValue::LinkageTypes::PrivateLinkage,
-									 strVal, ".str");
+		llvm::GlobalValue* globVal = nullptr;
+		if (!ctx.mIsShard)
+		{
+			// Make the llvm value for this string
+			llvm::Constant* strVal = llvm::ConstantDataArray::getString(ctx.mGlobal, str->mText);
+			
+			globVal = new llvm::GlobalVariable(*ctx.mModule, type, true,
+											   llvm::GlobalValue::LinkageTypes::PrivateLinkage,
+											   strVal, ".str");
+		}
+		else
+		{
+			// A shard only declares the strings, and the linker resolves
+			// them to the definitions in the main module. They're created
+			// in the same order, so they get the same names.
+			globVal = new llvm::GlobalVariable(*ctx.mModule, type, true,
+											   llvm::GlobalValue::LinkageTypes::ExternalLinkage,
+											   nullptr, ".str");
+		}
 		// This can be "unnamed" since the address location is not significant
 		globVal->setUnnamedAddr(true);
 		// Strings are 1-aligned
 		//globVal->setAlignment(1);
 		
-		str->mValue = globVal;
+		ctx.mStrValues[str] = globVal;
 	}
 }
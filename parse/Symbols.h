@@ -18,13 +18,16 @@
 #include <memory>
 #include <unordered_map>
 #include <list>
+#include <vector>
 
 #include "Types.h"
+#include "MemReport.h"
 
 namespace llvm
 {
 	class Value;
 	class Type;
+	class LLVMContext;
 }
 
 namespace uscc
@@ -100,7 +103,7 @@ public:
 		mAddress = value;
 	}
 	
-	llvm::Type* llvmType(bool treatArrayAsPtr = true) noexcept;
+	llvm::Type* llvmType(llvm::LLVMContext& context, bool treatArrayAsPtr = true) noexcept;
 	
 	llvm::Value* readFrom(CodeContext& ctx) noexcept;
 	
@@ -114,7 +117,9 @@ private:
 	, mAddress(nullptr)
 	, mType(Type::Void)
 	, mArrayCount(-1)
-	{ }
+	{
+		MemReport::get().add(MemReport::Identifiers, sizeof(Identifier) + mName.capacity());
+	}
 	
 	std::string mName;
 	std::shared_ptr<ASTFunction> mFunctionNode;
@@ -194,6 +199,10 @@ public:
 		// Hash table contains all the identifiers in this scope
 		std::unordered_map<std::string, Identifier*> mSymbols;
 		
+		// The identifiers in the order they were declared
+		// (so emission doesn't depend on the hash order)
+		std::vector<Identifier*> mDeclOrder;
+		
 		// List of the child tables
 		std::list<ScopeTable*> mChildren;
 		
@@ -213,7 +222,6 @@ class ConstStr
 public:
 	ConstStr(std::string& text)
 	: mText(text)
-	, mValue(nullptr)
 	{
 		
 	}
@@ -222,14 +230,8 @@ public:
 	{
 		return mText;
 	}
-	
-	llvm::Value* getValue() const noexcept
-	{
-		return mValue;
-	}
 private:
 	std::string mText;
-	llvm::Value* mValue;
 };
 	
 class StringTable
@@ -244,9 +246,14 @@ public:
 	ConstStr* getString(std::string& val) noexcept;
 	
 	// Emit this table to the IR contstants
+	// (For a shard of the program, these are only declarations)
 	void emitIR(CodeContext& ctx) noexcept;
 private:
 	std::unordered_map<std::string, ConstStr*> mStrings;
+	
+	// The strings in the order they first appear in the source
+	// (so emission doesn't depend on the hash order)
+	std::vector<ConstStr*> mOrder;
 };
 
 } // uscc
@@ -0,0 +1,277 @@
+//
+//  TimeTrace.cpp
+//  uscc
+//
+//  Implements the self-profiling support used by
+//  -ftime-trace and -ftime-report.
+//
+//---------------------------------------------------------
+//  Copyright (c) 2014, Sanjay Madhav
+//  All rights reserved.
+//
+//  This file is distributed under the BSD license.
+//  See LICENSE.TXT for details.
+//---------------------------------------------------------
+
+#include "TimeTrace.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+
+using namespace uscc::parse;
+
+namespace
+{
+	// Trace timestamps/durations are in microseconds
+	long long toMicro(TimeTrace::Clock::duration d)
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+	}
+
+	double toMilli(TimeTrace::Clock::duration d)
+	{
+		return std::chrono::duration<double, std::milli>(d).count();
+	}
+
+	// Index of the calling thread's row in the trace
+	// (or -1 if it hasn't added any events yet)
+	thread_local int threadIndex = -1;
+
+	// Writes a string with the characters JSON requires escaping
+	void writeJSONString(std::ostream& output, const std::string& str)
+	{
+		output << '"';
+		for (char c : str)
+		{
+			switch (c)
+			{
+				case '"':
+					output << "\\\"";
+					break;
+				case '\\':
+					output << "\\\\";
+					break;
+				case '\n':
+					output << "\\n";
+					break;
+				case '\t':
+					output << "\\t";
+					break;
+				default:
+					// (Every other control character has to be written as \u00XX)
+					if (static_cast<unsigned char>(c) < 0x20)
+					{
+						const char* hexDigits = "0123456789abcdef";
+						output << "\\u00" << hexDigits[(c >> 4) & 0xf] << hexDigits[c & 0xf];
+					}
+					else
+					{
+						output << c;
+					}
+					break;
+			}
+		}
+		output << '"';
+	}
+}
+
+TimeTrace::TimeTrace() noexcept
+: mNumThreads(0)
+, mEnabled(false)
+{
+
+}
+
+// Returns the trace for this compilation
+TimeTrace& TimeTrace::get() noexcept
+{
+	static TimeTrace trace;
+	return trace;
+}
+
+// Starts recording events. Timestamps are relative
+// to when this is called.
+void TimeTrace::enable() noexcept
+{
+	mEnabled = true;
+	mStart = Clock::now();
+}
+
+// Records a completed event
+void TimeTrace::addEvent(const char* name, const std::string& detail,
+						 Clock::time_point start, Clock::time_point end) noexcept
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	// Threads are numbered in the order they first add an event,
+	// so the main thread is always the first row
+	if (threadIndex == -1)
+	{
+		threadIndex = mNumThreads++;
+	}
+
+	Event e;
+	e.mName = name;
+	e.mDetail = detail;
+	e.mStart = start - mStart;
+	e.mDuration = end - start;
+	e.mThread = threadIndex;
+	mEvents.push_back(e);
+}
+
+// Adds to the running total for a phase that is too
+// fine-grained to record individual events for (such as lexing)
+void TimeTrace::addTotal(const char* name, Clock::duration duration) noexcept
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	for (auto& t : mTotals)
+	{
+		if (std::strcmp(t.mName, name) == 0)
+		{
+			t.mDuration += duration;
+			t.mCount++;
+			return;
+		}
+	}
+
+	Total t;
+	t.mName = name;
+	t.mDuration = duration;
+	t.mCount = 1;
+	mTotals.push_back(t);
+}
+
+// Computes the per-phase totals from the events and the
+// running totals
+std::vector<TimeTrace::Total> TimeTrace::computeTotals() const noexcept
+{
+	std::vector<Total> totals = mTotals;
+	for (const auto& e : mEvents)
+	{
+		auto iter = std::find_if(totals.begin(), totals.end(), [&e](const Total& t) {
+			return std::strcmp(t.mName, e.mName) == 0;
+		});
+
+		if (iter != totals.end())
+		{
+			iter->mDuration += e.mDuration;
+			iter->mCount++;
+		}
+		else
+		{
+			Total t;
+			t.mName = e.mName;
+			t.mDuration = e.mDuration;
+			t.mCount = 1;
+			totals.push_back(t);
+		}
+	}
+
+	std::sort(totals.begin(), totals.end(), [](const Total& a, const Total& b) {
+		return a.mDuration > b.mDuration;
+	});
+
+	return totals;
+}
+
+// Writes the events in the Chrome trace-event JSON format.
+// Returns false if the file couldn't be opened.
+bool TimeTrace::writeTrace(const char* fileName) const noexcept
+{
+	std::ofstream file(fileName);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	file << "{\"traceEvents\":[";
+
+	bool first = true;
+	for (const auto& e : mEvents)
+	{
+		if (!first)
+		{
+			file << ",";
+		}
+		first = false;
+
+		file << "\n{\"pid\":1,\"tid\":" << e.mThread << ",\"ph\":\"X\",\"cat\":\"uscc\",\"name\":";
+		writeJSONString(file, e.mName);
+		file << ",\"ts\":" << toMicro(e.mStart);
+		file << ",\"dur\":" << toMicro(e.mDuration);
+		if (!e.mDetail.empty())
+		{
+			file << ",\"args\":{\"detail\":";
+			writeJSONString(file, e.mDetail);
+			file << "}";
+		}
+		file << "}";
+	}
+
+	// Like clang, the per-phase totals go on their own rows
+	// (this is the only place fine-grained phases like lexing show up)
+	int tid = std::max(mNumThreads, 1);
+	for (const auto& t : computeTotals())
+	{
+		if (!first)
+		{
+			file << ",";
+		}
+		first = false;
+
+		file << "\n{\"pid\":1,\"tid\":" << tid++ << ",\"ph\":\"X\",\"cat\":\"uscc\",\"name\":";
+		writeJSONString(file, std::string("Total ") + t.mName);
+		file << ",\"ts\":0,\"dur\":" << toMicro(t.mDuration);
+		file << ",\"args\":{\"count\":" << t.mCount << "}}";
+	}
+
+	file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+	return true;
+}
+
+// Prints the time spent in each phase to the specified stream
+void TimeTrace::printReport(std::ostream& output) const noexcept
+{
+	double wall = toMilli(Clock::now() - mStart);
+
+	output << "===---------------------------------------------------------===\n";
+	output << "                      uscc time report\n";
+	output << "===---------------------------------------------------------===\n";
+	output << "  Total Execution Time: " << std::fixed << std::setprecision(3)
+		   << wall << " ms\n\n";
+	output << "   Time (ms)   (%)     Count  Name\n";
+
+	for (const auto& t : computeTotals())
+	{
+		double ms = toMilli(t.mDuration);
+		double percent = (wall > 0.0) ? (ms * 100.0 / wall) : 0.0;
+
+		output << std::setw(12) << std::setprecision(3) << ms;
+		output << std::setw(7) << std::setprecision(1) << percent << "%";
+		output << std::setw(9) << t.mCount << "  " << t.mName << '\n';
+	}
+
+	output << std::endl;
+}
+
+TimeScope::TimeScope(const char* name, const std::string& detail /* = "" */) noexcept
+: mName(name)
+, mDetail(detail)
+, mEnabled(TimeTrace::get().isEnabled())
+{
+	if (mEnabled)
+	{
+		mStart = TimeTrace::Clock::now();
+	}
+}
+
+TimeScope::~TimeScope() noexcept
+{
+	if (mEnabled)
+	{
+		TimeTrace::get().addEvent(mName, mDetail, mStart, TimeTrace::Clock::now());
+	}
+}
@@ -0,0 +1,122 @@
+//
+//  TimeTrace.h
+//  uscc
+//
+//  Declares the self-profiling support used by
+//  -ftime-trace and -ftime-report.
+//
+//  Phases of the compiler wrap themselves in a
+//  TimeScope, which records an event in the global
+//  TimeTrace (if it is enabled). Events can be added
+//  from any thread, and each thread gets its own row
+//  in the trace.
+//
+//---------------------------------------------------------
+//  Copyright (c) 2014, Sanjay Madhav
+//  All rights reserved.
+//
+//  This file is distributed under the BSD license.
+//  See LICENSE.TXT for details.
+//---------------------------------------------------------
+
+#pragma once
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace uscc
+{
+namespace parse
+{
+
+class TimeTrace
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	// Returns the trace for this compilation
+	static TimeTrace& get() noexcept;
+
+	// Starts recording events. Timestamps are relative
+	// to when this is called.
+	void enable() noexcept;
+
+	bool isEnabled() const noexcept
+	{
+		return mEnabled;
+	}
+
+	// Records a completed event
+	void addEvent(const char* name, const std::string& detail,
+				  Clock::time_point start, Clock::time_point end) noexcept;
+
+	// Adds to the running total for a phase that is too
+	// fine-grained to record individual events for (such as lexing)
+	void addTotal(const char* name, Clock::duration duration) noexcept;
+
+	// Writes the events in the Chrome trace-event JSON format.
+	// Returns false if the file couldn't be opened.
+	bool writeTrace(const char* fileName) const noexcept;
+
+	// Prints the time spent in each phase to the specified stream
+	void printReport(std::ostream& output) const noexcept;
+private:
+	TimeTrace() noexcept;
+
+	struct Event
+	{
+		const char* mName;
+		std::string mDetail;
+		Clock::duration mStart;
+		Clock::duration mDuration;
+		int mThread;
+	};
+
+	struct Total
+	{
+		const char* mName;
+		Clock::duration mDuration;
+		size_t mCount;
+	};
+
+	// Computes the per-phase totals from the events and the
+	// running totals
+	std::vector<Total> computeTotals() const noexcept;
+
+	std::vector<Event> mEvents;
+	std::vector<Total> mTotals;
+	std::mutex mMutex;
+	Clock::time_point mStart;
+	// Number of threads that have added events
+	int mNumThreads;
+	bool mEnabled;
+};
+
+// Records the time from construction to destruction as
+// an event in the TimeTrace
+class TimeScope
+{
+public:
+	TimeScope(const char* name, const std::string& detail = "") noexcept;
+	~TimeScope() noexcept;
+
+	// Used when the detail isn't known until partway through the scope
+	// (such as the name of a function that's being parsed)
+	void setDetail(const std::string& detail) noexcept
+	{
+		mDetail = detail;
+	}
+private:
+	TimeScope(const TimeScope& copy);
+	TimeScope& operator=(const TimeScope& rhs);
+
+	const char* mName;
+	std::string mDetail;
+	TimeTrace::Clock::time_point mStart;
+	bool mEnabled;
+};
+
+} // parse
+} // uscc
@@ -0,0 +1,65 @@
+#---------------------------------------------------------
+# Copyright (c) 2014, Sanjay Madhav
+# All rights reserved.
+#
+# This file is distributed under the BSD license.
+# See LICENSE.TXT for details.
+#---------------------------------------------------------
+import subprocess
+import os
+import sys
+import glob
+
+import unittest
+uscc = "../bin/uscc"
+
+__unittest = True
+
+class DeterminismTests(unittest.TestCase):
+	
+	def setUp(self):
+		self.maxDiff = None
+		if not os.path.isfile(uscc):
+			raise Exception("Can't run without uscc")
+
+	# compiles the file in a new uscc process, and returns the
+	# bitcode (or None if it didn't compile)
+	def compileOnce(self, fileName, outName, flags):
+		# a shared build cache would hide any differences
+		env = dict(os.environ)
+		env.pop("USCC_CACHE_DIR", None)
+		with open(os.devnull, "w") as devnull:
+			result = subprocess.call([uscc] + flags + ["-o", outName, fileName], stdout=devnull, stderr=devnull, env=env)
+		if result != 0:
+			return None
+		outFile = open(outName, "rb")
+		bitcode = outFile.read()
+		outFile.close()
+		os.remove(outName)
+		return bitcode
+
+	# every test that compiles must produce the same bitcode
+	# with the first and second set of flags
+	def checkDeterminism(self, firstFlags, secondFlags):
+		for fileName in sorted(glob.glob("*.usc")):
+			baseName = fileName[:-len(".usc")]
+			first = self.compileOnce(fileName, baseName + ".det1.bc", firstFlags)
+			second = self.compileOnce(fileName, baseName + ".det2.bc", secondFlags)
+			self.assertEqual(first is None, second is None, fileName + " only compiled once")
+			if first is not None:
+				self.assertTrue(first == second, fileName + " emitted different bitcode")
+	
+	def test_Deterministic(self):
+		self.checkDeterminism([], [])
+	
+	def test_DeterministicOpt(self):
+		self.checkDeterminism(["-O"], ["-O"])
+	
+	def test_ParallelMatchesSerial(self):
+		self.checkDeterminism([], ["-j", "4"])
+	
+	def test_ParallelMatchesSerialOpt(self):
+		self.checkDeterminism(["-O"], ["-O", "-j", "4"])
+
+if __name__ == '__main__':
+	unittest.main(verbosity=2)
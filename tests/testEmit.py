@@ -78,6 +78,15 @@ class EmitTests(unittest.TestCase):
 	def test_Emit_quicksort(self):
 		self.checkEmit("quicksort")
 		
+	def test_Emit_ssa02(self):
+		self.checkEmit("ssa02")
+		
+	def test_Emit_ssa03(self):
+		self.checkEmit("ssa03")
+		
+	def test_Emit_ssa04(self):
+		self.checkEmit("ssa04")
+		
 	def test_Emit_015(self):
 		self.checkEmit("test015")
 		
@@ -104,5 +113,50 @@ class EmitTests(unittest.TestCase):
 		
 	def test_Emit_opt07(self):
 		self.checkEmit("opt07")
+		
+	def test_Emit_opt08(self):
+		self.checkEmit("opt08")
+		
+	def test_Emit_opt09(self):
+		self.checkEmit("opt09")
+		
+	def test_Emit_scope01(self):
+		self.checkEmit("scope01")
+		
+	def test_Emit_logic01(self):
+		self.checkEmit("logic01")
+		
+	def test_Emit_cond01(self):
+		self.checkEmit("cond01")
+		
+	def test_Emit_loop01(self):
+		self.checkEmit("loop01")
+		
+	def test_Emit_opt10(self):
+		self.checkEmit("opt10")
+		
+	def test_Emit_opt11(self):
+		self.checkEmit("opt11")
+		
+	def test_Emit_opt12(self):
+		self.checkEmit("opt12")
+		
+	def test_Emit_opt13(self):
+		self.checkEmit("opt13")
+		
+	def test_Emit_opt14(self):
+		self.checkEmit("opt14")
+		
+	def test_Emit_opt15(self):
+		self.checkEmit("opt15")
+		
+	def test_Emit_opt16(self):
+		self.checkEmit("opt16")
+		
+	def test_Emit_opt17(self):
+		self.checkEmit("opt17")
+		
+	def test_Emit_opt18(self):
+		self.checkEmit("opt18")
 if __name__ == '__main__':
 	unittest.main(verbosity=2)
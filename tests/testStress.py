@@ -0,0 +1,61 @@
+#---------------------------------------------------------
+# Copyright (c) 2014, Sanjay Madhav
+# All rights reserved.
+#
+# This file is distributed under the BSD license.
+# See LICENSE.TXT for details.
+#---------------------------------------------------------
+import subprocess
+import os
+import sys
+
+import unittest
+uscc = "../bin/uscc"
+lli = "../../bin/lli"
+
+__unittest = True
+
+# Each if statement adds two blocks (if.then and if.end)
+numIfs = 50000
+
+class StressTests(unittest.TestCase):
+	
+	def setUp(self):
+		self.maxDiff = None
+		if not os.path.isfile(uscc):
+			raise Exception("Can't run without uscc")
+		if not os.path.isfile(lli):
+			raise Exception("lli not found at ../../bin/lli")
+
+	# writes a function with a chain of 100k blocks, where b is only
+	# read at the end (so the SSA builder has to walk the whole chain)
+	def writeChain(self, fileName):
+		source = open(fileName + ".usc", "w")
+		source.write("// Generated by testStress.py\n")
+		source.write("int main()\n{\n\tint a = 0;\n\tint b = 7;\n")
+		for i in range(numIfs):
+			source.write("\tif (a >= 0) a = a + 1;\n")
+		source.write("\tprintf(\"%d %d\\n\", a, b);\n\treturn 0;\n}\n")
+		source.close()
+
+	def checkStress(self, fileName, flags):
+		self.writeChain(fileName)
+		try:
+			subprocess.check_output([uscc] + flags + [fileName + ".usc"], stderr=subprocess.STDOUT)
+			resultStr = subprocess.check_output([lli, fileName + ".bc"], stderr=subprocess.STDOUT)
+			self.assertMultiLineEqual("%d 7\n" % numIfs, resultStr)
+		except subprocess.CalledProcessError as e:
+			self.fail("\n" + e.output)
+		finally:
+			os.remove(fileName + ".usc")
+			if os.path.isfile(fileName + ".bc"):
+				os.remove(fileName + ".bc")
+	
+	def test_Stress_chain(self):
+		self.checkStress("stress01", [])
+	
+	def test_Stress_chainOpt(self):
+		self.checkStress("stress02", ["-O"])
+
+if __name__ == '__main__':
+	unittest.main(verbosity=2)
@@ -0,0 +1,219 @@
+//
+//  BuildCache.cpp
+//  uscc
+//
+//  Implements the content-addressed cache used by
+//  --cache-dir.
+//
+//---------------------------------------------------------
+//  Copyright (c) 2014, Sanjay Madhav
+//  All rights reserved.
+//
+//  This file is distributed under the BSD license.
+//  See LICENSE.TXT for details.
+//---------------------------------------------------------
+
+#include "BuildCache.h"
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wconversion"
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MD5.h>
+#include <llvm/Support/raw_ostream.h>
+#pragma clang diagnostic pop
+
+#include <fstream>
+#include <sstream>
+
+using namespace uscc;
+
+namespace
+{
+	// Reads the entire file into contents.
+	// Returns false if the file couldn't be opened.
+	bool readFile(const std::string& fileName, std::string& contents)
+	{
+		std::ifstream file(fileName.c_str(), std::ios::in | std::ios::binary);
+		if (!file.is_open())
+		{
+			return false;
+		}
+
+		std::ostringstream buffer;
+		buffer << file.rdbuf();
+		contents = buffer.str();
+		return !file.bad();
+	}
+
+	// Returns the MD5 of the data, as a hex string
+	std::string hashString(const std::string& data)
+	{
+		llvm::MD5 hash;
+		hash.update(data);
+
+		llvm::MD5::MD5Result result;
+		hash.final(result);
+
+		llvm::SmallString<32> str;
+		llvm::MD5::stringifyResult(result, str);
+		return str.str().str();
+	}
+
+	// Writes the contents to a uniquely named file first, and then
+	// renames it to path, so concurrent readers never see a partially
+	// written file. (The directory has to exist.)
+	void writeFileAtomically(const std::string& path, const std::string& contents)
+	{
+		int fd = -1;
+		llvm::SmallString<128> tempPath;
+		if (llvm::sys::fs::createUniqueFile(path + "-%%%%%%%%.tmp", fd, tempPath))
+		{
+			return;
+		}
+
+		{
+			llvm::raw_fd_ostream temp(fd, true);
+			temp.write(contents.data(), contents.size());
+			temp.close();
+			if (temp.has_error())
+			{
+				temp.clear_error();
+				llvm::sys::fs::remove(tempPath.str());
+				return;
+			}
+		}
+
+		// If another process wrote the same file first, the rename
+		// replaces it with identical contents (or fails, on Windows)
+		if (llvm::sys::fs::rename(tempPath.str(), path))
+		{
+			llvm::sys::fs::remove(tempPath.str());
+		}
+	}
+}
+
+// Creates a cache that uses the specified directory
+// (it's created on the first store, if necessary)
+BuildCache::BuildCache(const std::string& dir) noexcept
+: mDir(dir)
+{
+
+}
+
+// Returns a hash of the running uscc executable, which identifies
+// the build of the compiler (or an empty string if it can't be read)
+std::string BuildCache::getCompilerId(const char* argv0) noexcept
+{
+	// (The address is of any function in the executable)
+	std::string exe = llvm::sys::fs::getMainExecutable(argv0,
+		reinterpret_cast<void*>(&readFile));
+
+	llvm::sys::fs::file_status status;
+	if (exe.empty() || llvm::sys::fs::status(exe, status))
+	{
+		return std::string();
+	}
+
+	// Hashing the executable takes longer than most compiles, so the
+	// hash is kept in the cache, keyed by the path, size, modification
+	// time and file ID of the executable (which a new build changes)
+	std::ostringstream stamp;
+	stamp << exe.size() << ':' << exe << ':' << status.getSize() << ':'
+		  << status.getLastModificationTime().toEpochTime() << ':'
+		  << status.getUniqueID().getDevice() << ':' << status.getUniqueID().getFile();
+	std::string idPath = mDir + "/compiler-" + hashString(stamp.str()) + ".id";
+
+	std::string id;
+	if (readFile(idPath, id) && id.size() == 32)
+	{
+		return id;
+	}
+
+	std::string contents;
+	if (!readFile(exe, contents))
+	{
+		return std::string();
+	}
+
+	id = hashString(contents);
+	if (!llvm::sys::fs::create_directories(mDir))
+	{
+		writeFileAtomically(idPath, id);
+	}
+	return id;
+}
+
+// Computes the key for this source file and options.
+// Returns false if the source file can't be read.
+bool BuildCache::computeKey(const char* fileName, const std::string& options) noexcept
+{
+	std::string source;
+	if (!readFile(fileName, source))
+	{
+		return false;
+	}
+
+	// The lengths are hashed too, so the boundaries between
+	// the fields can't be shifted to produce the same key
+	std::ostringstream header;
+	header << options.size() << ':' << options << ':' << source.size() << ':';
+	mKey = hashString(header.str() + source);
+
+	return true;
+}
+
+// If there is an entry for the current key, copies it to
+// outFile and returns true
+bool BuildCache::fetch(const std::string& outFile) noexcept
+{
+	if (mKey.empty())
+	{
+		return false;
+	}
+
+	// Entries are only ever renamed into place, so if it exists,
+	// it's complete
+	std::string contents;
+	if (!readFile(getEntryPath(), contents))
+	{
+		return false;
+	}
+
+	std::ofstream out(outFile.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!out.is_open())
+	{
+		return false;
+	}
+
+	out.write(contents.data(), contents.size());
+	return !out.fail();
+}
+
+// Adds the contents of outFile as the entry for the current key
+void BuildCache::store(const std::string& outFile) noexcept
+{
+	if (mKey.empty())
+	{
+		return;
+	}
+
+	std::string contents;
+	if (!readFile(outFile, contents))
+	{
+		return;
+	}
+
+	if (llvm::sys::fs::create_directories(mDir))
+	{
+		return;
+	}
+
+	writeFileAtomically(getEntryPath(), contents);
+}
+
+// Returns the path of the entry for the current key
+std::string BuildCache::getEntryPath() const noexcept
+{
+	return mDir + "/" + mKey + ".bc";
+}
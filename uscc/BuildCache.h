@@ -0,0 +1,59 @@
+//
+//  BuildCache.h
+//  uscc
+//
+//  Declares the content-addressed cache used by
+//  --cache-dir.
+//
+//  Entries are keyed by a hash of the compiler executable,
+//  the options that affect the output, and the bytes of
+//  the source file. Entries are written to a temporary
+//  file and renamed into place, so any number of uscc
+//  processes can share one cache directory.
+//
+//---------------------------------------------------------
+//  Copyright (c) 2014, Sanjay Madhav
+//  All rights reserved.
+//
+//  This file is distributed under the BSD license.
+//  See LICENSE.TXT for details.
+//---------------------------------------------------------
+
+#pragma once
+#include <string>
+
+namespace uscc
+{
+
+class BuildCache
+{
+public:
+	// Creates a cache that uses the specified directory
+	// (it's created on the first store, if necessary)
+	BuildCache(const std::string& dir) noexcept;
+
+	// Returns a hash of the running uscc executable, which identifies
+	// the build of the compiler (or an empty string if it can't be read).
+	// The hash is kept in the cache directory, so it's only computed
+	// the first time a build of uscc is run.
+	std::string getCompilerId(const char* argv0) noexcept;
+
+	// Computes the key for this source file and options.
+	// Returns false if the source file can't be read.
+	bool computeKey(const char* fileName, const std::string& options) noexcept;
+
+	// If there is an entry for the current key, copies it to
+	// outFile and returns true
+	bool fetch(const std::string& outFile) noexcept;
+
+	// Adds the contents of outFile as the entry for the current key
+	void store(const std::string& outFile) noexcept;
+private:
+	// Returns the path of the entry for the current key
+	std::string getEntryPath() const noexcept;
+
+	std::string mDir;
+	std::string mKey;
+};
+
+} // uscc
@@ -17,7 +17,14 @@
 #include "../parse/Parse.h"
 #include "../parse/ParseExcept.h"
 #include "../parse/Emitter.h"
+#include "../parse/TimeTrace.h"
+#include "../parse/MemReport.h"
+#include "BuildCache.h"
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
+#include <string>
+#include <thread>
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wcast-qual"
 #pragma clang diagnostic push
@@ -29,67 +36,120 @@
 
 using namespace uscc;
 
-int main(int argc, const char * argv[])
+// Returns the file name with the last extension replaced with ext
+static std::string replaceExtension(const std::string& file, const char* ext)
 {
-	ez::ezOptionParser opt;
-	opt.doublespace = 1;
-	opt.overview = "University Simple C Compiler v0.5";
-	opt.syntax = "uscc [OPTIONS] <input>";
-	
-	opt.add("", false, 0, 0,
-			"Display this message.",
-			"-h", "--help");
-	opt.add("", false, 0, 0,
-			"Output parse AST to stdout, and do not proceed to further compilation steps. "
-			"(Unless -b or -s is also specified.)",
-			"-a", "--print-ast");
-	opt.add("", false, 0, 0,
-			"(DEFAULT) Generates LLVM bitcode file."
-			" This is done by default if"
-			" -a or -s is not specified.\n\nTo force bitcode to be written even if -a or -s are"
-			" set, you can specify -b, as well.",
-			"-b", "--bitcode");
-	opt.add("", false, 0, 0,
-			"Output symbol table to stdout.",
-			"-l", "--print-symbols");
-	opt.add("", false, 0, 0,
-			"Output LLVM IR to stdout.",
-			"-p", "--print-bc");
-	opt.add("", false, 0, 0,
-			"Enable optimization passes.",
-			"-O");
-	// Note: ASM generation disabled
-	/*opt.add("", false, 0, 0,
-			"Generate an x86 assembly file from the LLVM IR generated by uscc."
-			" No optimization is performed."
-			"\n\nThis is provided for convenience in case LLVM developer tools (specifically llc)"
-			" are not installed. GCC or clang can turn this assembly file into an executable.",
-			"-s", "--assembly");*/
-	opt.add("", false, 1, 0,
-			"Specify output file. This is ignored if -b and -s are specified simultaneously.",
-			"-o", "--output");
-	
-	opt.parse(argc, argv);
-	if (opt.isSet("-h"))
+	std::string retVal = file;
+	size_t extLoc = retVal.find_last_of(".");
+	if (extLoc != std::string::npos)
 	{
-		std::string usage;
-		opt.getUsage(usage);
-		std::cout << usage;
-		return 0;
+		// Strip the last extension
+		retVal = retVal.substr(0, extLoc);
+	}
+	retVal += ext;
+	return retVal;
+}
+
+// Returns the name of the bitcode file to write
+static std::string getBitcodeFile(ez::ezOptionParser& opt, const char* fileName)
+{
+	std::string bcFile;
+	// If output file not specified, default is
+	// input file with the extension replaced with .bc
+	if (!opt.isSet("-o") || opt.isSet("-s"))
+	{
+		bcFile = replaceExtension(fileName, ".bc");
+	}
+	else
+	{
+		ez::OptionGroup* params = opt.get("-o");
+		params->getString(bcFile);
 	}
+	return bcFile;
+}
+
+// Returns the build cache directory, or an empty string if
+// the cache is disabled
+static std::string getCacheDir(ez::ezOptionParser& opt)
+{
+	std::string cacheDir;
+	if (opt.isSet("--cache-dir"))
+	{
+		opt.get("--cache-dir")->getString(cacheDir);
+	}
+	else if (const char* env = std::getenv("USCC_CACHE_DIR"))
+	{
+		cacheDir = env;
+	}
+	return cacheDir;
+}
+
+// Returns the options for the opt passes
+static uscc::opt::OptOptions getOptOptions(ez::ezOptionParser& opt)
+{
+	uscc::opt::OptOptions options;
+	options.mPrintRanges = opt.isSet("-fprint-ranges");
 	
-	if (opt.lastArgs.size() < 1)
+	// Loops are unrolled by default. If both -funroll-loops and
+	// -fno-unroll-loops are set, the one that's last wins.
+	if (opt.isSet("-fno-unroll-loops"))
 	{
-		std::cerr << "uscc: error: No input file specified." << std::endl;
-		return 1;
+		options.mUnrollLoops = opt.isSet("-funroll-loops") &&
+			opt.get("-funroll-loops")->parseIndex.back() >
+			opt.get("-fno-unroll-loops")->parseIndex.back();
 	}
-	if (opt.lastArgs.size() > 1)
+	if (opt.isSet("-funroll-factor"))
 	{
-		std::cerr << "uscc: error: Only a single input file is supported." << std::endl;
-		return 1;
+		int factor = 0;
+		opt.get("-funroll-factor")->getInt(factor);
+		options.mUnrollFactor = static_cast<unsigned>(std::max(factor, 1));
+	}
+	return options;
+}
+
+// Returns the build of the compiler and the options that change
+// the emitted bitcode, which are part of the build cache key
+static std::string getCacheOptions(ez::ezOptionParser& opt, const std::string& compilerId)
+{
+	std::string options = opt.overview + " " + compilerId;
+	if (opt.isSet("-O"))
+	{
+		options += " -O";
+		
+		uscc::opt::OptOptions optOptions = getOptOptions(opt);
+		if (optOptions.mUnrollLoops)
+		{
+			options += " -funroll-factor " + std::to_string(optOptions.mUnrollFactor);
+		}
+		else
+		{
+			options += " -fno-unroll-loops";
+		}
+	}
+	return options;
+}
+
+// Returns the number of threads to emit and optimize with
+// (0 means one per core)
+static unsigned getJobs(ez::ezOptionParser& opt)
+{
+	int jobs = 1;
+	if (opt.isSet("-j"))
+	{
+		opt.get("-j")->getInt(jobs);
 	}
 	
-	const char* fileName = opt.lastArgs[0]->c_str();
+	if (jobs == 0)
+	{
+		jobs = static_cast<int>(std::thread::hardware_concurrency());
+	}
+	return static_cast<unsigned>(std::max(jobs, 1));
+}
+
+// Runs the compilation steps requested by the options.
+// Returns the exit code for uscc.
+static int compile(ez::ezOptionParser& opt, const char* argv0, const char* fileName)
+{
 	std::ostream* astStream = nullptr;
 	bool outputSymbols = false;
 	if (opt.isSet("-a"))
@@ -102,6 +162,29 @@ int main(int argc, const char * argv[])
 		outputSymbols = true;
 	}
 	
+	// The cache is only used if the bitcode file is the only output
+	std::string cacheDir = getCacheDir(opt);
+	bool useCache = !cacheDir.empty() &&
+		!opt.isSet("-a") && !opt.isSet("-l") && !opt.isSet("-p") &&
+		!opt.isSet("-fprint-ranges");
+	BuildCache cache(cacheDir);
+	if (useCache)
+	{
+		parse::TimeScope timer("CacheLookup");
+		
+		// (If the compiler's build can't be identified, bitcode from
+		// another build could be returned, so the cache isn't used)
+		std::string compilerId = cache.getCompilerId(argv0);
+		useCache = !compilerId.empty();
+		
+		// (If the file can't be read, the parser will report it)
+		if (useCache && cache.computeKey(fileName, getCacheOptions(opt, compilerId)) &&
+			cache.fetch(getBitcodeFile(opt, fileName)))
+		{
+			return 0;
+		}
+	}
+	
 	try
 	{
 		parse::Parser parser(fileName, &std::cerr, astStream, outputSymbols);
@@ -112,6 +195,8 @@ int main(int argc, const char * argv[])
 			return 1;
 		}
 		
+		parse::MemReport::get().snapshot("Parse");
+		
 		// If we set -a, we don't continue to later steps
 		if (opt.isSet("-a") &&
 			!opt.isSet("-b") && !opt.isSet("-s") && !opt.isSet("-p"))
@@ -120,12 +205,22 @@ int main(int argc, const char * argv[])
 		}
 		
 		// Now emit LLVM bitcode
-		parse::Emitter emit(parser);
+		parse::Emitter emit(parser, getJobs(opt));
+		// (The shards are counted without linking them, so the
+		// memory report doesn't change how they're optimized)
+		if (parse::MemReport::get().isEnabled())
+		{
+			parse::MemReport::get().snapshot("Emit", emit.getModules());
+		}
 		
 		// Check if we should run optimization passes
 		if (opt.isSet("-O"))
 		{
-			emit.optimize();
+			emit.optimize(getOptOptions(opt));
+			if (parse::MemReport::get().isEnabled())
+			{
+				parse::MemReport::get().snapshot("Optimize", emit.getModules());
+			}
 		}
 		
 		bool shouldEmitBC = true;
@@ -134,6 +229,13 @@ int main(int argc, const char * argv[])
 			shouldEmitBC = false;
 		}
 		
+		// The shards (if there are any) are linked before they're output
+		if (!emit.linkShards())
+		{
+			std::cerr << "uscc: error: Unable to link the functions. Compilation halted." << std::endl;
+			return 1;
+		}
+		
 		// Print the human readable bitcode to stdout
 		if (opt.isSet("-p"))
 		{
@@ -151,27 +253,19 @@ int main(int argc, const char * argv[])
 		// Write the bitcode file
 		if (shouldEmitBC)
 		{
-			std::string bcFile;
-			// If output file not specified, default is
-			// input file with the extension replaced with .bc
-			if (!opt.isSet("-o") || opt.isSet("-s"))
+			std::string bcFile = getBitcodeFile(opt, fileName);
+			if (!emit.writeBitcode(bcFile.c_str()))
 			{
-				bcFile = fileName;
-				size_t extLoc = bcFile.find_last_of(".");
-				if (extLoc != std::string::npos)
-				{
-					// Strip the last extension
-					bcFile = bcFile.substr(0, extLoc);
-				}
-				bcFile += ".bc";
+				std::cerr << "uscc: error: Unable to write bitcode. Compilation halted." << std::endl;
+				return 1;
 			}
-			else
+			
+			// (This is only reached if the bitcode was written, so a
+			// stale file at that path can't be stored under this key)
+			if (useCache)
 			{
-				ez::OptionGroup* params = opt.get("-o");
-				params->getString(bcFile);
+				cache.store(bcFile);
 			}
-			
-			emit.writeBitcode(bcFile.c_str());
 		}
 		
 		// Functionality removed because it doesn't work with LLVM 3.5.0
@@ -217,3 +311,145 @@ int main(int argc, const char * argv[])
 	return 0;
 }
 
+int main(int argc, const char * argv[])
+{
+	ez::ezOptionParser opt;
+	opt.doublespace = 1;
+	opt.overview = "University Simple C Compiler v0.5";
+	opt.syntax = "uscc [OPTIONS] <input>";
+	
+	opt.add("", false, 0, 0,
+			"Display this message.",
+			"-h", "--help");
+	opt.add("", false, 0, 0,
+			"Output parse AST to stdout, and do not proceed to further compilation steps. "
+			"(Unless -b or -s is also specified.)",
+			"-a", "--print-ast");
+	opt.add("", false, 0, 0,
+			"(DEFAULT) Generates LLVM bitcode file."
+			" This is done by default if"
+			" -a or -s is not specified.\n\nTo force bitcode to be written even if -a or -s are"
+			" set, you can specify -b, as well.",
+			"-b", "--bitcode");
+	opt.add("", false, 0, 0,
+			"Output symbol table to stdout.",
+			"-l", "--print-symbols");
+	opt.add("", false, 0, 0,
+			"Output LLVM IR to stdout.",
+			"-p", "--print-bc");
+	opt.add("", false, 0, 0,
+			"Enable optimization passes.",
+			"-O");
+	// Note: ASM generation disabled
+	/*opt.add("", false, 0, 0,
+			"Generate an x86 assembly file from the LLVM IR generated by uscc."
+			" No optimization is performed."
+			"\n\nThis is provided for convenience in case LLVM developer tools (specifically llc)"
+			" are not installed. GCC or clang can turn this assembly file into an executable.",
+			"-s", "--assembly");*/
+	opt.add("", false, 1, 0,
+			"Specify output file. This is ignored if -b and -s are specified simultaneously.",
+			"-o", "--output");
+	opt.add("", false, 1, 0,
+			"Emit and optimize the functions on the specified number of threads (0 uses one"
+			" per core). The functions are split into that many shards, which are linked"
+			" together at the end, so the output is the same as with -j 1.",
+			"-j", "--jobs");
+	opt.add("", false, 0, 0,
+			"Record where compile time is spent, and write it as Chrome trace-event JSON"
+			" (viewable in chrome://tracing). The trace is written next to the bitcode file,"
+			" with the extension replaced with .json.",
+			"-ftime-trace");
+	opt.add("", false, 0, 0,
+			"Print a summary of the time spent in each compilation phase to stderr.",
+			"-ftime-report");
+	opt.add("", false, 0, 0,
+			"Print the peak memory use, and the number and size of the compiler's data structures"
+			" (AST nodes, symbols, SSA maps, LLVM IR) allocated in each compilation phase to stderr.",
+			"-fmem-report");
+	opt.add("", false, 0, 0,
+			"Print the range of values each integer can have, as computed for the optimizer,"
+			" to stderr. (Only if -O is also specified.)",
+			"-fprint-ranges");
+	opt.add("", false, 0, 0,
+			"(DEFAULT) Unroll the loops that run a constant number of times. Small loops are"
+			" replaced with a copy of the body per iteration, and larger ones run several copies"
+			" per iteration. (Only if -O is also specified.)"
+			"\n\nIf this and -fno-unroll-loops are both specified, the last one is used.",
+			"-funroll-loops");
+	opt.add("", false, 0, 0,
+			"Do not unroll loops.",
+			"-fno-unroll-loops");
+	opt.add("", false, 1, 0,
+			"Specify the number of copies of the body that a partially unrolled loop runs per"
+			" iteration (the default is 4, and 1 only unrolls loops fully).",
+			"-funroll-factor");
+	opt.add("", false, 1, 0,
+			"Cache bitcode in the specified directory, keyed by the contents of the input, the"
+			" options and the build of uscc (a hash of its executable). On a hit, the cached bitcode is written without"
+			" parsing the input. The directory can be shared by concurrent uscc processes."
+			"\n\nIf this isn't specified, the USCC_CACHE_DIR environment variable is used.",
+			"--cache-dir");
+	
+	opt.parse(argc, argv);
+	if (opt.isSet("-h"))
+	{
+		std::string usage;
+		opt.getUsage(usage);
+		std::cout << usage;
+		return 0;
+	}
+	
+	if (opt.lastArgs.size() < 1)
+	{
+		std::cerr << "uscc: error: No input file specified." << std::endl;
+		return 1;
+	}
+	if (opt.lastArgs.size() > 1)
+	{
+		std::cerr << "uscc: error: Only a single input file is supported." << std::endl;
+		return 1;
+	}
+	
+	const char* fileName = opt.lastArgs[0]->c_str();
+	
+	bool timeTrace = opt.isSet("-ftime-trace");
+	bool timeReport = opt.isSet("-ftime-report");
+	if (timeTrace || timeReport)
+	{
+		parse::TimeTrace::get().enable();
+	}
+	
+	bool memReport = opt.isSet("-fmem-report");
+	if (memReport)
+	{
+		parse::MemReport::get().enable();
+	}
+	
+	int retVal = 0;
+	{
+		parse::TimeScope timer("Compile", fileName);
+		retVal = compile(opt, argv[0], fileName);
+	}
+	
+	if (timeTrace)
+	{
+		std::string traceFile = replaceExtension(getBitcodeFile(opt, fileName), ".json");
+		if (!parse::TimeTrace::get().writeTrace(traceFile.c_str()))
+		{
+			std::cerr << "uscc: error: Unable to write time trace " << traceFile << "." << std::endl;
+		}
+	}
+	
+	if (timeReport)
+	{
+		parse::TimeTrace::get().printReport(std::cerr);
+	}
+	
+	if (memReport)
+	{
+		parse::MemReport::get().printReport(std::cerr);
+	}
+	
+	return retVal;
+}